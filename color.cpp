@@ -21,44 +21,80 @@ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./color.h"
+#include "./simd.h"
 
 namespace color {
 
-__attribute__ ((hot, optimize("Os"), flatten))
-vector::float4 gradient::repeat(float i) const {
+__attribute__ ((always_inline))
+inline luv16 gradient::lookup(float i) const {
+    // Table index in the high bits, q15 fraction in the low ones
+    uint32_t q = uint32_t(i * ( colors_mul * float(simd::q15One) ));
+    size_t index = q >> 15;
+    int32_t t = int32_t(q & ( simd::q15One - 1 ));
+    const luv16 &a = colors[index & colors_mask];
+    if (t == 0) {
+        return a;
+    }
+    return simd::lerp(a, colors[(index + 1) & colors_mask], t);
+}
+
+static inline float wrap(float i) {
     i = fabsf(i);
-    i -= truncf(i);
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
+    return i - truncf(i);
 }
 
-__attribute__ ((hot, optimize("Os"), flatten))
-vector::float4 gradient::reflect(float i) const {
+static inline float mirror(float i) {
     i = fabsf(i);
     if ((static_cast<int32_t>(i) & 1) == 0) {
-        i -= truncf(i);
-    } else {
-        i -= truncf(i);
-        i = 1.0f - i;
+        return i - truncf(i);
     }
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
+    return 1.0f - ( i - truncf(i) );
+}
+
+static inline float saturate(float i) {
+    return std::clamp(i, 0.0f, 1.0f);
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 gradient::repeat(float i) const {
+    return lookup(wrap(i));
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 gradient::reflect(float i) const {
+    return lookup(mirror(i));
 }
 
 __attribute__ ((hot, optimize("Os"), flatten))
 vector::float4 gradient::clamp(float i) const {
-    if (i <= 0.0f) {
-        return colors[0];
+    return lookup(saturate(i));
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void gradient::repeat(std::span<const float> pos, std::span<luv16> out) const {
+    for (size_t c = 0; c < std::min(pos.size(), out.size()); c++) {
+        out[c] = lookup(wrap(pos[c]));
     }
-    if (i >= 1.0f) {
-        return colors[colors_n-1];
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void gradient::reflect(std::span<const float> pos, std::span<luv16> out) const {
+    for (size_t c = 0; c < std::min(pos.size(), out.size()); c++) {
+        out[c] = lookup(mirror(pos[c]));
     }
-    i *= colors_mul;
-    return vector::float4::lerp(colors[(static_cast<size_t>(i))&colors_mask], colors[(static_cast<size_t>(i)+1)&colors_mask], i - truncf(i));
 }
 
 __attribute__ ((hot, optimize("Os"), flatten))
-vector::float4 convert::CIELUV2sRGB(const vector::float4 &in) const {
+void gradient::clamp(std::span<const float> pos, std::span<luv16> out) const {
+    for (size_t c = 0; c < std::min(pos.size(), out.size()); c++) {
+        out[c] = lookup(saturate(pos[c]));
+    }
+}
+
+const convert::transfer_table convert::transfer;
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 convert::CIELUV2lRGB(const vector::float4 &in) const {
     const float wu = 0.197839825f;
     const float wv = 0.468336303f;
 
@@ -75,6 +111,13 @@ vector::float4 convert::CIELUV2sRGB(const vector::float4 &in) const {
     float g = -0.9692660f * x +  1.8760108f * y +  0.0415560f * z;
     float b =  0.0556434f * x + -0.2040259f * y +  1.0572252f * z;
 
+    return vector::float4(r, g, b);
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+vector::float4 convert::CIELUV2sRGB(const vector::float4 &in) const {
+    vector::float4 l(CIELUV2lRGB(in));
+
     auto sRGBTransfer = [] (float a) {
         if (a <= 0.0f) {
             return 0.0f;
@@ -87,7 +130,13 @@ vector::float4 convert::CIELUV2sRGB(const vector::float4 &in) const {
         }
     };
 
-    return vector::float4(sRGBTransfer(r),sRGBTransfer(g),sRGBTransfer(b));
+    return vector::float4(sRGBTransfer(l.x),sRGBTransfer(l.y),sRGBTransfer(l.z));
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+rgba<uint16_t> convert::CIELUV2sRGB16(const vector::float4 &in) const {
+    vector::float4 l(CIELUV2lRGB(in));
+    return rgba<uint16_t>(transfer(l.x), transfer(l.y), transfer(l.z));
 }
 
 }
@@ -28,6 +28,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cmath>
 #include <cfloat>
 #include <array>
+#include <span>
+#include <type_traits>
 
 #include "./vector.h"
 #include "./fastmath.h"
@@ -125,9 +127,67 @@ namespace color {
         return __builtin_arm_usat(uint32_t(v * 65535.f), 16);
     }
 
+    // CIELUV packed into three signed Q2.13 halfwords, 6 bytes instead of a 16 byte float4
+    struct luv16 {
+
+        int16_t l;
+        int16_t u;
+        int16_t v;
+
+        constexpr luv16() :
+            l(0),
+            u(0),
+            v(0) {
+        }
+
+        constexpr luv16(const vector::float4 &from) :
+            l(pack(from.x)),
+            u(pack(from.y)),
+            v(pack(from.z)) {
+        }
+
+        operator vector::float4() const {
+            return vector::float4(float(l) * ( 1.0f / scale ),
+                                  float(u) * ( 1.0f / scale ),
+                                  float(v) * ( 1.0f / scale ));
+        }
+
+        // Unpack and multiply by f in one go
+        vector::float4 scaled(float f) const {
+            f *= ( 1.0f / scale );
+            return vector::float4(float(l) * f,
+                                  float(u) * f,
+                                  float(v) * f);
+        }
+
+        bool operator==(const luv16 &) const = default;
+
+        static constexpr int32_t fractionBits = 13;
+
+    private:
+        static constexpr float scale = float(1 << fractionBits);
+
+        __attribute__((always_inline)) static constexpr int16_t pack(float f) {
+            if (std::is_constant_evaluated()) {
+                return int16_t(std::clamp(int32_t(f * scale), int32_t(-32768), int32_t(32767)));
+            }
+            return int16_t(__builtin_arm_ssat(int32_t(f * scale), 16));
+        }
+    };
+
     class gradient {
     public:
-        template<class T, std::size_t N> consteval gradient(const T (&stops)[N]) {
+        constexpr gradient() : colors() {
+        }
+
+        template<class T, std::size_t N> consteval gradient(const T (&stops)[N]) : colors() {
+            build(stops, N);
+        }
+
+        // Same table as the consteval constructor, for palettes only known at runtime. Stops are
+        // CIELUV colors with the position in w, at least two of them. Outside the stops the end
+        // colors repeat and zero width segments are hard steps, so no stop list yields NaN.
+        template<class T> constexpr void build(const T *stops, std::size_t N) {
             for (size_t c = 0; c < colors_n; c++) {
                 float f = static_cast<float>(c) / static_cast<float>(colors_n - 1);
                 vector::float4 a = stops[0];
@@ -141,9 +201,9 @@ namespace color {
                         }
                     }
                 }
-                f -= a.w;
-                f /= b.w - a.w;
-                colors[c] = a.lerp(b,f);
+                float w = b.w - a.w;
+                f = w > 0.0f ? std::clamp(( f - a.w ) / w, 0.0f, 1.0f) : ( f < a.w ? 0.0f : 1.0f );
+                colors[c] = luv16(a.lerp(b,f));
             }
         }
 
@@ -151,12 +211,21 @@ namespace color {
         vector::float4 reflect(float i) const;
         vector::float4 clamp(float i) const;
 
+        // Sample every position in pos into out, one call per ring instead of one per LED
+        void repeat(std::span<const float> pos, std::span<luv16> out) const;
+        void reflect(std::span<const float> pos, std::span<luv16> out) const;
+        void clamp(std::span<const float> pos, std::span<luv16> out) const;
+
     private:
         static constexpr size_t colors_n = 256;
         static constexpr float colors_mul = 255.0;
         static constexpr size_t colors_mask = 0xFF;
 
-        vector::float4 colors[colors_n];
+        // i from 0 to 1, interpolated in fixed point
+        luv16 lookup(float i) const;
+
+        // Packed CIELUV, 1.5KB per table
+        luv16 colors[colors_n];
     };
 
     class convert {
@@ -194,10 +263,44 @@ namespace color {
                 (d > (1.0f / 65536.0f)) ? 13.0f * l * ( ( 9.0f * Y * di ) - wv ) : 0.0f);
         }
 
+        vector::float4 CIELUV2lRGB(const vector::float4 &) const;
         vector::float4 CIELUV2sRGB(const vector::float4 &) const;
+        rgba<uint16_t> CIELUV2sRGB16(const vector::float4 &) const;
 
     private:
         float sRGB2lRGB[256];
+
+        // Linear -> 16-bit sRGB, 4096 cells, interpolated with the low 4 bits of a 16-bit fixed point input
+        static const struct transfer_table {
+            static constexpr size_t cells_n = 4096;
+            static constexpr size_t cells_shift = 4;
+            static constexpr size_t cells_mask = ( 1UL << cells_shift ) - 1;
+
+            consteval transfer_table() : table() {
+                for (size_t c = 0; c <= cells_n; c++) {
+                    float a = float(c) / float(cells_n);
+                    float v = 0.0f;
+                    if (a < 0.0031308f) {
+                        v = a * 12.92f;
+                    } else if (a < 1.0f) {
+                        v = constexpr_pow(a, 1.0f / 2.4f) * 1.055f - 0.055f;
+                    } else {
+                        v = 1.0f;
+                    }
+                    table[c] = uint16_t(std::min(v * 65535.0f + 0.5f, 65535.0f));
+                }
+            }
+
+            __attribute__((always_inline)) uint16_t operator()(float v) const {
+                uint32_t i = __builtin_arm_usat(int32_t(v * 65536.0f), 16);
+                uint32_t a = table[(i >> cells_shift) + 0];
+                uint32_t b = table[(i >> cells_shift) + 1];
+                return uint16_t(a + ( ( ( b - a ) * ( i & cells_mask ) ) >> cells_shift ));
+            }
+
+        private:
+            uint16_t table[cells_n + 1];
+        } transfer;
     };
 
     constexpr vector::float4 lRGB2CIELUV(const vector::float4 &in) {
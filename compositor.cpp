@@ -0,0 +1,161 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./compositor.h"
+#include "./simd.h"
+
+#include <algorithm>
+
+Compositor::Compositor() {
+    for (size_t s = 0; s < Leds::sidesN; s++) {
+        for (size_t c = 0; c < Leds::circleLedsN; c++) {
+            wipeKey[Layer::circleIndex(s, c)] = Leds::map.getCircle(c).y;
+        }
+        for (size_t c = 0; c < Leds::birdLedsN; c++) {
+            wipeKey[Layer::birdIndex(s, c)] = Leds::map.getBird(c).y;
+        }
+    }
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        // Top to bottom
+        wipeKey[c] = std::clamp(( 1.0f - wipeKey[c] ) * 0.5f, 0.0f, 1.0f);
+        // Fixed scatter, good enough to look random
+        uint32_t h = uint32_t(c) * 0x9E3779B1UL;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6DUL;
+        h ^= h >> 12;
+        dissolveKey[c] = float(h & 0xFFFF) * ( 1.0f / 65536.0f );
+    }
+    single();
+}
+
+void Compositor::single() {
+    if (layers[layersN - 1].enabled && !layers[layersN - 2].enabled) {
+        return;
+    }
+    for (size_t c = 0; c < layersN; c++) {
+        layers[c].enabled = c == layersN - 1;
+        layers[c].alpha.fill(1.0f);
+    }
+    updateHidden();
+}
+
+void Compositor::transition(Transition type, float progress) {
+    if (progress >= 1.0f) {
+        single();
+        return;
+    }
+
+    Layer &bottom = layers[layersN - 2];
+    Layer &top = layers[layersN - 1];
+
+    bottom.enabled = true;
+    bottom.alpha.fill(1.0f);
+    top.enabled = true;
+
+    static constexpr float wipeEdge = 0.1f;
+
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        switch (type) {
+            case Crossfade:
+                top.alpha[c] = progress;
+            break;
+            case Wipe:
+                top.alpha[c] = std::clamp((progress * ( 1.0f + wipeEdge ) - wipeKey[c]) * ( 1.0f / wipeEdge ), 0.0f, 1.0f);
+            break;
+            case Dissolve:
+                top.alpha[c] = progress > dissolveKey[c] ? 1.0f : 0.0f;
+            break;
+        }
+    }
+
+    updateHidden();
+}
+
+void Compositor::updateHidden() {
+    std::array<bool, Leds::ledsN> covered {};
+    for (size_t l = layersN; l-- > 0; ) {
+        Layer &layer = layers[l];
+        layer.hidden = covered;
+        if (!layer.enabled) {
+            layer.hidden.fill(true);
+            continue;
+        }
+        for (size_t c = 0; c < Leds::ledsN; c++) {
+            if (layer.alpha[c] * layer.opacity <= 0.0f) {
+                layer.hidden[c] = true;
+            } else if (layer.blend == Alpha && layer.alpha[c] * layer.opacity >= 1.0f) {
+                covered[c] = true;
+            }
+        }
+    }
+}
+
+// Blending stays in packed CIELUV, see simd.h
+void Compositor::compose(std::span<color::luv16, Leds::ledsN> out) {
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        color::luv16 col;
+        for (size_t l = 0; l < layersN; l++) {
+            const Layer &layer = layers[l];
+            if (layer.hidden[c]) {
+                continue;
+            }
+            color::luv16 src(layer.leds[c]);
+            switch (layer.blend) {
+                case Alpha:
+                break;
+                case Add:
+                    src = simd::add(col, src);
+                break;
+                case Multiply:
+                    // Scale by the lightness of the layer
+                    src = simd::multiply(col, src);
+                break;
+            }
+            int32_t a = simd::toQ15(layer.alpha[c] * layer.opacity);
+            if (a <= 0) {
+                continue;
+            }
+            col = a >= simd::q15One ? src : simd::lerp(col, src, a);
+        }
+        out[c] = col;
+    }
+}
+
+void Compositor::composeKey() {
+    keyFrames[0] = keyFrames[1];
+    compose(keyFrames[1]);
+}
+
+void Compositor::interpolate(std::span<color::luv16, Leds::ledsN> out, float t) const {
+    int32_t a = simd::toQ15(t);
+    if (a >= simd::q15One) {
+        std::copy(keyFrames[1].begin(), keyFrames[1].end(), out.begin());
+        return;
+    }
+    if (a <= 0) {
+        std::copy(keyFrames[0].begin(), keyFrames[0].end(), out.begin());
+        return;
+    }
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        out[c] = simd::lerp(keyFrames[0][c], keyFrames[1][c], a);
+    }
+}
@@ -0,0 +1,124 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+#include "./leds.h"
+#include "./color.h"
+
+#include <array>
+#include <span>
+
+// Stacks offscreen layers into the LED framebuffer. Each effect renders into its own layer once
+// per frame, layer 0 is at the bottom. LEDs of a layer which are completely covered by an opaque
+// layer above are marked hidden so effects can skip them.
+class Compositor {
+public:
+    static constexpr size_t layersN = 2;
+
+    enum Blend {
+        Alpha,
+        Add,
+        Multiply
+    };
+
+    enum Transition {
+        Crossfade,
+        Wipe,
+        Dissolve
+    };
+
+    class Layer {
+    public:
+        void setCircle(size_t side, size_t index, const vector::float4 &c) {
+            leds[circleIndex(side, index)] = c;
+        }
+
+        void setCircle(size_t side, size_t index, const color::luv16 &c) {
+            leds[circleIndex(side, index)] = c;
+        }
+
+        void setBird(size_t side, size_t index, const vector::float4 &c) {
+            leds[birdIndex(side, index)] = c;
+        }
+
+        bool visibleCircle(size_t side, size_t index) const {
+            return !hidden[circleIndex(side, index)];
+        }
+
+        bool visibleBird(size_t side, size_t index) const {
+            return !hidden[birdIndex(side, index)];
+        }
+
+        bool active() const { return enabled; }
+
+        Blend blend = Alpha;
+        float opacity = 1.0f;
+
+    private:
+        friend class Compositor;
+
+        static size_t circleIndex(size_t side, size_t index) {
+            return Leds::topology::index(Leds::circleSegment(side % Leds::sidesN), index % Leds::circleLedsN);
+        }
+
+        static size_t birdIndex(size_t side, size_t index) {
+            return Leds::topology::index(Leds::birdSegment(side % Leds::sidesN), index % Leds::birdLedsN);
+        }
+
+        std::array<color::luv16, Leds::ledsN> leds;
+        std::array<float, Leds::ledsN> alpha;
+        std::array<bool, Leds::ledsN> hidden;
+        bool enabled = false;
+    };
+
+    Compositor();
+
+    Layer &layer(size_t index) { return layers[index % layersN]; }
+
+    // Show only the top layer
+    void single();
+
+    // Bring in the top layer over the bottom one, progress runs from 0 to 1
+    void transition(Transition type, float progress);
+
+    void compose(std::span<color::luv16, Leds::ledsN> out);
+
+    // Key frames for effects which render below the frame rate. composeKey() composes the next key
+    // frame, interpolate() fills out between the last two with t from 0 to 1.
+    void composeKey();
+    void interpolate(std::span<color::luv16, Leds::ledsN> out, float t) const;
+
+private:
+    void updateHidden();
+
+    std::array<Layer, layersN> layers;
+
+    // Per LED thresholds for wipe and dissolve
+    std::array<float, Leds::ledsN> wipeKey;
+    std::array<float, Leds::ledsN> dissolveKey;
+
+    std::array<std::array<color::luv16, Leds::ledsN>, 2> keyFrames;
+};
+
+#endif /* COMPOSITOR_H_ */
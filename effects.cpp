@@ -25,13 +25,18 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./leds.h"
 #include "./model.h"
 #include "./color.h"
+#include "./palette.h"
 #include "./fastmath.h"
-#include "./seed.h"
+#include "./profiler.h"
+#include "./stm32wl.h"
 
-#include <random>
 #include <array>
+#include <algorithm>
 #include <limits>
 #include <math.h>
+#ifdef USE_FUNCTION_KERNELS
+#include <functional>
+#endif  // #ifdef USE_FUNCTION_KERNELS
 
 static constexpr color::gradient gradient_rainbow({
     color::srgb8_stop({0xff,0x00,0x00}, 0.00f),
@@ -43,6 +48,64 @@ static constexpr color::gradient gradient_rainbow({
     color::srgb8_stop({0xff,0x00,0x00}, 1.00f)
 });
 
+#ifdef USE_FUNCTION_KERNELS
+template<class F> static std::function<vector::float4 (const vector::float4 &, float)> kernel_func(F &&func) { return func; }
+#else  // #ifdef USE_FUNCTION_KERNELS
+template<class F> static F kernel_func(F &&func) { return func; }
+#endif  // #ifdef USE_FUNCTION_KERNELS
+
+// Per LED kernels. func is called as func(pos, walk) for every visible LED of side 0 in
+// the layer and is inlined into the loop.
+template<class F> static void bird_kernel(Compositor::Layer &layer, float walk, F &&f) {
+    auto func = kernel_func(std::forward<F>(f));
+    for (size_t c = 0; c < Leds::birdLedsN; c++) {
+        if (layer.visibleBird(0, c)) {
+            auto pos = Leds::map.getBird(c);
+            layer.setBird(0, c, func(pos, walk));
+        }
+    }
+}
+
+template<class F> static void circle_walk_kernel(Compositor::Layer &layer, float val_walk, F &&f) {
+    auto func = kernel_func(std::forward<F>(f));
+    for (size_t c = 0; c < Leds::circleLedsN; c++) {
+        if (layer.visibleCircle(0, c)) {
+            float mod_walk = fracf(val_walk + (1.0f - (c * ( 1.0f / static_cast<float>(Leds::circleLedsN)))));
+            auto pos = Leds::map.getBird(c);
+            layer.setCircle(0, c, func(pos, mod_walk));
+        }
+    }
+}
+
+static_assert(Effects::effectsN == Model::effectCount);
+
+std::array<Effects::Entry, Effects::effectsN> Effects::registry {{
+    { "RGB Band",       &Effects::rgb_band,     sizeof(Effects::rgb_band_state),    150000, HalfRate },
+    { "Light Walker",   &Effects::light_walker, 0,                                  150000, FullRate },
+    { "Color Walker",   &Effects::color_walker, 0,                                  100000, FullRate },
+    { "Brilliance",     &Effects::brilliance,   sizeof(Effects::brilliance_state),  100000, FullRate }
+}};
+
+uint32_t Effects::frameBudget() {
+    return uint32_t(float(Profiler::frequency()) * ( frameBudgetShare / float(Timeline::effectRate) ));
+}
+
+uint32_t Effects::rateDivider(uint32_t cost) const {
+    uint32_t budget = frameBudget();
+    return std::min(maxRateDivider, std::max(uint32_t(1), ( cost + budget - 1 ) / budget));
+}
+
+bool Effects::lowBattery() {
+    return STM32WL::instance().DevicePresent() && STM32WL::instance().BatteryVoltage() < lowBatteryVoltage;
+}
+
+void Effects::render(size_t effect, const FrameContext &frame, Compositor::Layer &layer) {
+    Entry &entry = registry[effect % effectsN];
+    uint32_t start = Profiler::now();
+    (this->*entry.render)(frame, layer);
+    entry.record(Profiler::now() - start);
+}
+
 Effects &Effects::instance() {
     static Effects effects;
     if (!effects.initialized) {
@@ -52,74 +115,45 @@ Effects &Effects::instance() {
     return effects;
 }
 
-void Effects::standard_bird() {
-    static float walker = 0.0f;
-    walker += 0.01f;
-    if (walker >= 1.0f) walker = 0.0f;
-    auto calc = [](const std::function<vector::float4 (const vector::float4 &pos, float walk)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::birdLedsN; c++) {
-            auto pos = Leds::instance().map.getBird(c);
-            auto col = func(pos, walker);
-            leds.setBird(0,c,col);
-            leds.setBird(1,c,col);
-        }
-    };
-    calc([=](const vector::float4 &pos, float walk) {
-        return color::srgb8(Model::instance().BirdColor()) + color::srgb8({0xff,0xff,0xff}) * fast_pow(1.0f - pos.w, 8.0f) * 0.25f * walk;
+void Effects::standard_bird(const FrameContext &frame, Compositor::Layer &layer) {
+    static constexpr vector::float4 white(color::srgb8({0xff,0xff,0xff}));
+    const vector::float4 bird(frame.birdColorLuv);
+    bird_kernel(layer, birdWalk, [=](const vector::float4 &pos, float walk) {
+        return bird + white * fast_pow(1.0f - pos.w, 8.0f) * 0.25f * walk;
     });
 }
 
-void Effects::color_walker() {
-    standard_bird();
-
-    double now = Timeline::SystemTime();
+void Effects::color_walker(const FrameContext &frame, Compositor::Layer &layer) {
+    standard_bird(frame, layer);
 
-    const double speed = 1.0;
+    static constexpr double speed = 1.0;
 
-    float rgb_walk = (       static_cast<float>(frac(now * (1.0 / 5.0) * speed)));
-    float val_walk = (1.0f - static_cast<float>(frac(now               * speed)));
+    float rgb_walk = (       Timeline::Phase(frame.time, Timeline::Ticks(5.0 / speed)));
+    float val_walk = (1.0f - Timeline::Phase(frame.time, Timeline::Ticks(1.0 / speed)));
 
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, float walk)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            float mod_walk = fracf(val_walk + (1.0f - (c * ( 1.0f / static_cast<float>(Leds::circleLedsN)))));
-            auto pos = Leds::instance().map.getBird(c);
-            auto col = func(pos, mod_walk);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
+    // Palettes from the SD card take over from the rainbow, a new one every walk
+    const color::gradient *gradient = &gradient_rainbow;
+    if (size_t count = Palettes::instance().fileCount(); count > 0) {
+        gradient = Palettes::instance().file(size_t(frame.time / Timeline::Ticks(5.0 / speed)) % count);
+    }
 
-    vector::float4 col(gradient_rainbow.repeat(rgb_walk));
-    calc([=](const vector::float4 &pos, float walk) {
+    vector::float4 col(gradient->repeat(rgb_walk));
+    circle_walk_kernel(layer, val_walk, [=](const vector::float4 &pos, float walk) {
         float v = fast_pow(std::min(1.0f, walk), 2.0f);;
         return col * v;
     });
 
 }
 
-void Effects::light_walker() {
-    standard_bird();
+void Effects::light_walker(const FrameContext &frame, Compositor::Layer &layer) {
+    standard_bird(frame, layer);
 
-    double now = Timeline::SystemTime();
+    static constexpr double speed = 1.0;
 
-    const double speed = 1.0;
+    float rgb_walk = (       Timeline::Phase(frame.time, Timeline::Ticks(5.0 / speed)));
+    float val_walk = (1.0f - Timeline::Phase(frame.time, Timeline::Ticks(1.0 / speed)));
 
-    float rgb_walk = (       static_cast<float>(frac(now * (1.0 / 5.0) * speed)));
-    float val_walk = (1.0f - static_cast<float>(frac(now               * speed)));
-
-    auto calc = [=](const std::function<vector::float4 (const vector::float4 &pos, float walk)> &func) {
-        Leds &leds(Leds::instance());
-        for (size_t c = 0; c < Leds::circleLedsN; c++) {
-            float mod_walk = fracf(val_walk + (1.0f - (c * ( 1.0f / static_cast<float>(Leds::circleLedsN)))));
-            auto pos = Leds::instance().map.getBird(c);
-            auto col = func(pos, mod_walk);
-            leds.setCircle(0, c, col);
-            leds.setCircle(1, Leds::circleLedsN-1-c, col);
-        }
-    };
-    calc([=](const vector::float4 &pos, float walk) {
+    circle_walk_kernel(layer, val_walk, [=](const vector::float4 &pos, float walk) {
         return color::hsv({rgb_walk, 1.0f - fast_pow(std::min(1.0f, walk), 6.0f), fast_pow(std::min(1.0f, walk), 6.0f)});
     });
 }
@@ -164,172 +198,191 @@ template<const std::size_t n> static void band_mapper(std::array<float, n> &stop
     }
 }
 
-void Effects::rgb_band() {
-
-    standard_bird();
-
-    static float rgb_band_r_walk = 0.0f;
-    static float rgb_band_g_walk = 0.0f;
-    static float rgb_band_b_walk = 0.0f;
+void Effects::rgb_band(const FrameContext &frame, Compositor::Layer &layer) {
 
-    static float rgb_band_r_walk_step = 1.0f;
-    static float rgb_band_g_walk_step = 1.0f;
-    static float rgb_band_b_walk_step = 1.0f;
+    standard_bird(frame, layer);
 
-    static std::mt19937 gen;
-    static std::uniform_real_distribution<float> disf(+0.001f, +0.005f);
-    static std::uniform_int_distribution<int32_t> disi(0, 1);
+    auto &state = rgbBand;
 
     std::array<float, Leds::circleLedsN> band_r;
     std::array<float, Leds::circleLedsN> band_g;
     std::array<float, Leds::circleLedsN> band_b;
 
-    if (fabsf(rgb_band_r_walk) >= 2.0f) {
-        while (rgb_band_r_walk >= +1.0f) { rgb_band_r_walk -= 1.0f; }
-        while (rgb_band_r_walk <= -1.0f) { rgb_band_r_walk += 1.0f; }
-        rgb_band_r_walk_step = disf(gen) * (disi(gen) ? 1.0f : -1.0f);
+    if (fabsf(state.r_walk) >= 2.0f) {
+        while (state.r_walk >= +1.0f) { state.r_walk -= 1.0f; }
+        while (state.r_walk <= -1.0f) { state.r_walk += 1.0f; }
+        state.r_walk_step = state.random.get(0.001f, 0.005f) * (state.random.get(0, 2) ? 1.0f : -1.0f);
     }
 
-    if (fabsf(rgb_band_g_walk) >= 2.0f) {
-        while (rgb_band_g_walk >= +1.0f) { rgb_band_g_walk -= 1.0f; }
-        while (rgb_band_g_walk <= -1.0f) { rgb_band_g_walk += 1.0f; }
-        rgb_band_g_walk_step = disf(gen) * (disi(gen) ? 1.0f : -1.0f);
+    if (fabsf(state.g_walk) >= 2.0f) {
+        while (state.g_walk >= +1.0f) { state.g_walk -= 1.0f; }
+        while (state.g_walk <= -1.0f) { state.g_walk += 1.0f; }
+        state.g_walk_step = state.random.get(0.001f, 0.005f) * (state.random.get(0, 2) ? 1.0f : -1.0f);
     }
 
-    if (fabsf(rgb_band_b_walk) >= 2.0f) {
-        while (rgb_band_b_walk >= +1.0f) { rgb_band_b_walk -= 1.0f; }
-        while (rgb_band_b_walk <= -1.0f) { rgb_band_b_walk += 1.0f; }
-        rgb_band_b_walk_step = disf(gen) * (disi(gen) ? 1.0f : -1.0f);
+    if (fabsf(state.b_walk) >= 2.0f) {
+        while (state.b_walk >= +1.0f) { state.b_walk -= 1.0f; }
+        while (state.b_walk <= -1.0f) { state.b_walk += 1.0f; }
+        state.b_walk_step = state.random.get(0.001f, 0.005f) * (state.random.get(0, 2) ? 1.0f : -1.0f);
     }
 
-    band_mapper(band_r, rgb_band_r_walk, rgb_band_r_walk + (1.0f / 3.0f));
-    band_mapper(band_g, rgb_band_g_walk, rgb_band_g_walk + (1.0f / 3.0f));
-    band_mapper(band_b, rgb_band_b_walk, rgb_band_b_walk + (1.0f / 3.0f));
+    band_mapper(band_r, state.r_walk, state.r_walk + (1.0f / 3.0f));
+    band_mapper(band_g, state.g_walk, state.g_walk + (1.0f / 3.0f));
+    band_mapper(band_b, state.b_walk, state.b_walk + (1.0f / 3.0f));
 
-    Leds &leds(Leds::instance());
     for (size_t c = 0; c < Leds::circleLedsN; c++) {
-        auto out = color::srgb({band_r[c], band_g[c], band_b[c]});
-        leds.setCircle(0, c, out);
-        leds.setCircle(1, Leds::circleLedsN-1-c, out);
+        if (layer.visibleCircle(0, c)) {
+            layer.setCircle(0, c, color::srgb({band_r[c], band_g[c], band_b[c]}));
+        }
     }
 
-    rgb_band_r_walk -= rgb_band_r_walk_step;
-    rgb_band_g_walk += rgb_band_g_walk_step;
-    rgb_band_b_walk += rgb_band_b_walk_step;
+    state.r_walk -= state.r_walk_step * float(frameStep);
+    state.g_walk += state.g_walk_step * float(frameStep);
+    state.b_walk += state.b_walk_step * float(frameStep);
 }
 
-void Effects::brilliance() {
-    standard_bird();
+void Effects::brilliance(const FrameContext &frame, Compositor::Layer &layer) {
+    standard_bird(frame, layer);
+
+    auto &state = brillianceState;
 
-/*    float now = static_cast<float>(Timeline::SystemTime());
+    Timeline::ticks now = frame.time;
 
-    static float next = -1.0f;
-    static float dir = 0.0f;
-    
-    if ((next - now) < 0.0f || next < 0.0f) {
-        next = now + random.get(2.0f, 20.0f);
-        dir = random.get(0.0f, 3.141f * 2.0f);
+    if (now >= state.next) {
+        state.next = now + Timeline::Ticks(random.get(2.0f, 20.0f));
+        state.dir = random.get(0.0f, 3.141f * 2.0f);
     }
 
-    static colors::gradient bw;
-    static colors::rgb8 col;
-    if (bw.check_init() || col != Model::instance().RingColor()) {
-        col = Model::instance().RingColor();
-        const geom::float4 bwg[] = {
-            geom::float4(Model::instance().RingColor().hex(), 0.00f),
-            geom::float4(Model::instance().RingColor().hex(), 0.14f),
-            geom::float4(0xffffff, 0.21f),
-            geom::float4(Model::instance().RingColor().hex(), 0.28f),
-            geom::float4(Model::instance().RingColor().hex(), 1.00f)};
-        bw.init(bwg,5);
+    float remaining = Timeline::Seconds(state.next - now);
+
+    // Only rebuilt when the ring color changes
+    uint32_t ring = frame.ringColor;
+    const Palettes::stop stops[] = {
+        { ring,     0.00f },
+        { ring,     0.14f },
+        { 0xffffff, 0.21f },
+        { ring,     0.28f },
+        { ring,     1.00f }
+    };
+    const color::gradient &bw = Palettes::instance().get(stops);
+
+    std::array<float, Leds::circleLedsN> pos;
+    for (size_t c = 0; c < Leds::circleLedsN; c++) {
+        vector::float4 p = Leds::map.getCircle(c).rotate2d(state.dir);
+        pos[c] = ( p.x * 0.50f + remaining * 8.0f ) * 0.05f;
     }
 
-    calc_outer([=](geom::float4 pos) {
-        pos = pos.rotate2d(dir);
-        pos *= 0.50f;
-        pos += (next - now) * 8.0f;
-        pos *= 0.05f;
-        return bw.clamp(pos.x);
-    });*/
+    std::array<color::luv16, Leds::circleLedsN> col;
+    bw.clamp(pos, col);
+
+    for (size_t c = 0; c < Leds::circleLedsN; c++) {
+        if (layer.visibleCircle(0, c)) {
+            layer.setCircle(0, c, col[c]);
+        }
+    }
 }
 
 void Effects::init() {
 
-    random.set_seed(Seed::instance().seedU32());
+    random = Random::stream(Random::EffectRandom);
+    rgbBand.random = Random::stream(Random::RGBBandWalk);
+
+    // All effects are symmetric, only side 0 gets rendered
+    Leds::instance().setSymmetry(Leds::Mirrored);
 
     static Timeline::Effect mainEffect;
 
     static uint32_t current_effect = 0;
     static uint32_t previous_effect = 0;
-    
-    static double switch_time = 0;
 
-    if (!Timeline::instance().Scheduled(mainEffect)) {
-        mainEffect.time = Timeline::SystemTime();
-        mainEffect.duration = std::numeric_limits<double>::infinity();
-        mainEffect.calcFunc = [this](Timeline::Span &, Timeline::Span &) {
-
-            if ( current_effect != Model::instance().Effect() ) {
-                previous_effect = current_effect;
-                current_effect = Model::instance().Effect();
-                switch_time = Timeline::SystemTime();
-            }
+    // Too expensive when last tried. Only local, the selection in Model stays what the user chose.
+    static uint32_t refused_effect = effectsN;
+    static Timeline::ticks refused_time = 0;
+
+    static Timeline::ticks switch_time = 0;
 
-            auto calc_effect = [this] (uint32_t effect) {
-                switch (effect) {
-                    case 0:
-                        rgb_band();
-                    break;
-                    case 1:
-                        light_walker();
-                    break;
-                    case 2:
-                        color_walker();
-                    break;
+    if (!Timeline::instance().Scheduled(mainEffect)) {
+        mainEffect.time = Timeline::Now();
+        mainEffect.duration = Timeline::forever;
+        mainEffect.calcFunc = [this](Timeline::Span &, const FrameContext &frame) {
+            Profiler::Scope profile(Profiler::EffectCalc);
+
+            auto refuse = [&](uint32_t effect) {
+                if (refused_effect != effect) {
+                    refused_effect = effect;
+                    refused_time = frame.time;
                 }
             };
 
-            double blend_duration = 0.5;
-            double now = Timeline::SystemTime();
-
-            Leds &leds(Leds::instance());
-
-            if ((now - switch_time) < blend_duration) {
-                calc_effect(previous_effect);
-
-                auto circleLedsPrev = leds.getCircle();
-                auto birdsLedsPrev = leds.getBird();
-
-                calc_effect(current_effect);
-
-                auto circleLedsNext = leds.getCircle();
-                auto birdsLedsNext = leds.getBird();
-
-                float blend = static_cast<float>(now - switch_time) * (1.0f / static_cast<float>(blend_duration));
+            // Turned out too expensive even at the lowest rate, go back to the one before
+            if (current_effect != previous_effect && !affordable(current_effect) && affordable(previous_effect)) {
+                refuse(current_effect);
+                current_effect = previous_effect;
+            }
 
-                for (size_t c = 0; c < circleLedsNext.size(); c++) {
-                    for (size_t d = 0; d < circleLedsNext[c].size(); d++) {
-                        circleLedsNext[c][d] = vector::float4::lerp(circleLedsPrev[c][d], circleLedsNext[c][d], blend);
-                    }
+            uint32_t wanted = Model::instance().Effect() % effectsN;
+            if ( current_effect != wanted ) {
+                if (wanted == refused_effect && frame.time - refused_time >= refuseRetry) {
+                    registry[wanted].forget();
+                    refused_effect = effectsN;
                 }
-
-                leds.setCircle(circleLedsNext);
-
-                for (size_t c = 0; c < birdsLedsNext.size(); c++) {
-                    for (size_t d = 0; d < birdsLedsNext[c].size(); d++) {
-                        birdsLedsNext[c][d] = vector::float4::lerp(birdsLedsPrev[c][d], birdsLedsNext[c][d], blend);
-                    }
+                if (!affordable(wanted)) {
+                    // Stay where we are
+                    refuse(wanted);
+                } else {
+                    previous_effect = current_effect;
+                    current_effect = wanted;
+                    switch_time = frame.time;
                 }
+            }
+
+            birdWalk += 0.01f;
+            if (birdWalk >= 1.0f) birdWalk = 0.0f;
 
-                leds.setBird(birdsLedsNext);
+            static constexpr Timeline::ticks blend_duration = Timeline::Ticks(0.5);
+            Timeline::ticks elapsed = frame.time - switch_time;
 
+            // Outgoing effect in the bottom layer, current one on top. Both have to fit into one
+            // frame, otherwise cut over without the extra layer.
+            uint32_t cost = registry[current_effect].cost;
+            if (elapsed < blend_duration && previous_effect != current_effect &&
+                cost + registry[previous_effect].cost <= frameBudget()) {
+                compositor.transition(Compositor::Crossfade, float(uint32_t(elapsed)) * (1.0f / float(blend_duration)));
+                cost += registry[previous_effect].cost;
             } else {
-                calc_effect(current_effect);
+                compositor.single();
+            }
+
+            // Effects over budget, with a reduced key rate or on low battery render key frames at a
+            // fraction of the effect rate, the frames in between are interpolated.
+            uint32_t divider = std::max({ rateDivider(cost),
+                                          uint32_t(registry[current_effect].keyRate),
+                                          lowBattery() ? uint32_t(QuarterRate) : uint32_t(FullRate) });
+            uint32_t phase = frame.index % divider;
+            if (phase == 0) {
+                frameStep = divider;
+                if (compositor.layer(0).active()) {
+                    render(previous_effect, frame, compositor.layer(0));
+                }
+                render(current_effect, frame, compositor.layer(1));
+                compositor.composeKey();
             }
 
+            // Land on the new key frame at the end of the interval
+            compositor.interpolate(frame.target, float(phase + 1) / float(divider));
+
         };
-        mainEffect.commitFunc = [this](Timeline::Span &) {
+        mainEffect.commitFunc = [this](Timeline::Span &span) {
             Leds::instance().apply();
+            // Black and powered off, frames can stop until something changes. Otherwise a frame
+            // which changed no LED is taken as a still picture and looked at again a bit later.
+            if (Leds::instance().dark()) {
+                span.stillUntil = Timeline::forever;
+            } else if (Leds::instance().settled()) {
+                span.stillUntil = Timeline::Now() + Timeline::stillRecheck;
+            } else {
+                span.stillUntil = 0;
+            }
         };
         Timeline::instance().Add(mainEffect);
     }
@@ -23,56 +23,120 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef EFFECTS_H_
 #define EFFECTS_H_
 
+#include "./compositor.h"
+#include "./random.h"
+#include "./timeline.h"
+#include "./frame.h"
+
 #include <stdint.h>
+#include <array>
+#include <algorithm>
+
+// Per LED calls through std::function, as before the template kernels. Only there to
+// benchmark against, see render_function in host/CMakeLists.txt.
+//#define USE_FUNCTION_KERNELS 1
 
 class Effects {
 public:
     static Effects &instance();
 
+    static constexpr size_t effectsN = 4;
+
+    static const char *name(size_t effect) { return registry[effect % effectsN].name; }
+
+    // Rate at which an effect renders key frames, the LED output interpolates in between
+    enum KeyRate : uint32_t {
+        FullRate = 1,       // Every frame, 120Hz
+        HalfRate = 2,       // 60Hz
+        QuarterRate = 4     // 30Hz
+    };
+
+    static void setKeyRate(size_t effect, KeyRate rate) { registry[effect % effectsN].keyRate = rate; }
+    static KeyRate keyRate(size_t effect) { return registry[effect % effectsN].keyRate; }
+
 private:
-    class pseudo_random {
-    public:
-        
-        void set_seed(uint32_t seed) {
-            uint32_t i;
-            a = 0xf1ea5eed, b = c = d = seed;
-            for (i=0; i<20; ++i) {
-                (void)get();
-            }
-        }
+    Random::Stream random;
 
-        #define rot(x,k) (((x)<<(k))|((x)>>(32-(k))))
-        uint32_t get() {
-            uint32_t e = a - rot(b, 27);
-            a = b ^ rot(c, 17);
-            b = c + d;
-            c = d + e;
-            d = e + a;
-            return d;
-        }
+    struct rgb_band_state {
+        float r_walk = 0.0f;
+        float g_walk = 0.0f;
+        float b_walk = 0.0f;
+
+        float r_walk_step = 1.0f;
+        float g_walk_step = 1.0f;
+        float b_walk_step = 1.0f;
+
+        Random::Stream random;
+    } rgbBand;
 
-        float get(float lower, float upper) {
-            return static_cast<float>(static_cast<double>(get()) * (static_cast<double>(upper-lower)/static_cast<double>(1LL<<32)) ) + lower;
+    struct brilliance_state {
+        Timeline::ticks next = 0;
+        float dir = 0.0f;
+    } brillianceState;
+
+    // Renders the cost estimate looks back on
+    static constexpr size_t costWindowN = 32;
+
+    // Selectable effects. cost is the worst case number of cycles of the last costWindowN
+    // renders, seeded with an estimate until the first measurement. An outlier only throttles
+    // an effect until it drops out of the window.
+    struct Entry {
+        const char *name;
+        void (Effects::*render)(const FrameContext &frame, Compositor::Layer &layer);
+        size_t stateSize;
+        uint32_t estimate;      // Cost assumed until the first measurement
+        KeyRate keyRate;
+        uint32_t cost = estimate;
+
+        std::array<uint32_t, costWindowN> costs {};
+        uint32_t costIndex = 0;
+
+        void record(uint32_t cycles) {
+            costs[costIndex] = cycles;
+            costIndex = ( costIndex + 1 ) % costWindowN;
+            cost = *std::max_element(costs.begin(), costs.end());
         }
 
-        int32_t get(int32_t lower, int32_t upper) {
-            return (static_cast<int32_t>(get()) % (upper-lower)) + lower;
+        // Measure from scratch on the next render, judged by the estimate until then
+        void forget() {
+            costs.fill(0);
+            cost = estimate;
         }
+    };
+
+    static std::array<Entry, effectsN> registry;
+
+    // Share of a Timeline::effectRate frame effects may spend, the rest is for compose and LED output
+    static constexpr float frameBudgetShare = 0.5f;
+    // Effects are refused if they can not run at 1/maxRateDivider of the effect rate
+    static constexpr uint32_t maxRateDivider = 4;
+
+    // Refused effects get measured again after this long, the refusal might have come from an outlier
+    static constexpr Timeline::ticks refuseRetry = Timeline::Ticks(5.0);
+
+    static uint32_t frameBudget();
+    static bool affordable(size_t effect) { return registry[effect % effectsN].cost <= frameBudget() * maxRateDivider; }
+    uint32_t rateDivider(uint32_t cost) const;
+    void render(size_t effect, const FrameContext &frame, Compositor::Layer &layer);
+
+    // Below this battery voltage every effect drops to QuarterRate
+    static constexpr float lowBatteryVoltage = 3.5f;
+    static bool lowBattery();
+
+    // Frames until the next key frame, effects which step their state per render advance by this
+    uint32_t frameStep = 1;
 
-    private:
-        uint32_t a; 
-        uint32_t b; 
-        uint32_t c; 
-        uint32_t d; 
+    void color_walker(const FrameContext &frame, Compositor::Layer &layer);
+    void light_walker(const FrameContext &frame, Compositor::Layer &layer);
+    void rgb_band(const FrameContext &frame, Compositor::Layer &layer);
+    void brilliance(const FrameContext &frame, Compositor::Layer &layer);
 
-    } random;
+    void standard_bird(const FrameContext &frame, Compositor::Layer &layer);
 
-    void color_walker();
-    void light_walker();
-    void rgb_band();
-    void brilliance();
+    Compositor compositor;
 
-    void standard_bird();
+    // Advanced once per frame, shared by every effect
+    float birdWalk = 0.0f;
 
     void init();
     bool initialized = false;
@@ -0,0 +1,52 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./frame.h"
+#include "./model.h"
+
+static uint32_t hex(const color::rgba<uint8_t> &c) {
+    return ( uint32_t(c.r) << 16 ) | ( uint32_t(c.g) << 8 ) | uint32_t(c.b);
+}
+
+FrameContext FrameClock::capture() {
+    Timeline::ticks now = Timeline::Now();
+    Timeline::ticks dt = started ? now - last : 0;
+    started = true;
+    last = now;
+
+    const Model &model = Model::instance();
+
+    // sRGB to CIELUV once per frame instead of per LED
+    static const color::convert converter;
+
+    return FrameContext {
+        now,
+        dt,
+        index++,
+        model.Brightness(),
+        hex(model.RingColor()),
+        hex(model.BirdColor()),
+        converter.sRGB2CIELUV(model.RingColor()),
+        converter.sRGB2CIELUV(model.BirdColor()),
+        Leds::instance().frame()
+    };
+}
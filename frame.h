@@ -0,0 +1,62 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "./timeline.h"
+#include "./leds.h"
+#include "./color.h"
+
+#include <stdint.h>
+#include <span>
+
+// Everything spans and effects read during a frame, captured once per tick. Hot loops work on
+// these plain values instead of calling into singletons, and every consumer in a frame sees the
+// same time and colors.
+struct FrameContext {
+    Timeline::ticks time;       // Timeline::Now() at the start of the frame
+    Timeline::ticks dt;         // Since the previous frame of the same clock
+    uint32_t index;             // Frames of the same clock so far
+
+    float brightness;
+
+    uint32_t ringColor;         // sRGB, 0xRRGGBB
+    uint32_t birdColor;
+    vector::float4 ringColorLuv;
+    vector::float4 birdColorLuv;
+
+    std::span<color::luv16, Leds::ledsN> target;
+};
+
+// One per frame rate, keeps index and dt across captures
+class FrameClock {
+public:
+    FrameContext capture();
+
+private:
+    Timeline::ticks last = 0;
+    uint32_t index = 0;
+    bool started = false;
+};
+
+#endif /* FRAME_H_ */
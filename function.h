@@ -0,0 +1,65 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef FUNCTION_H_
+#define FUNCTION_H_
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Fixed capacity stand-in for std::function. The callable lives inside the object, so nothing
+// is ever allocated. It has to be trivially copyable and destructible, which is what lambdas
+// capturing pointers and plain values are, so copies are plain copies and there is no manager
+// to dispatch through. A callable which does not fit fails to compile.
+template <class Signature, size_t Capacity = sizeof(void *)> class inplace_function;
+
+template <class R, class... Args, size_t Capacity>
+class inplace_function<R(Args...), Capacity> {
+public:
+    constexpr inplace_function() = default;
+    constexpr inplace_function(std::nullptr_t) { }
+
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, inplace_function> &&
+                                                std::is_invocable_r_v<R, F &, Args...>>>
+    inplace_function(F f) {
+        static_assert(sizeof(F) <= Capacity, "Captures do not fit, raise the capacity");
+        static_assert(alignof(F) <= alignof(void *), "Captures are over aligned");
+        static_assert(std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>,
+                      "Captures have to be trivially copyable and destructible");
+        ::new (static_cast<void *>(storage)) F(f);
+        invoker = [](void *callable, Args... args) -> R {
+            return (*static_cast<F *>(callable))(std::forward<Args>(args)...);
+        };
+    }
+
+    explicit operator bool() const { return invoker != nullptr; }
+
+    R operator()(Args... args) const { return invoker(storage, std::forward<Args>(args)...); }
+
+private:
+    alignas(void *) mutable unsigned char storage[Capacity] = {};
+    R (*invoker)(void *callable, Args... args) = nullptr;
+};
+
+#endif /* FUNCTION_H_ */
@@ -0,0 +1,274 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Encode cost against the share of LEDs which changed since the last frame.
+//
+//   encode [-f frames]
+//
+// Runs the real Leds::markChanged() and Leds::prepare() from ledsprepare.h in Mirrored mode
+// against stand-in transports, which keep the ring and bird buffers the way SPIRingTransport
+// and GPIODMABirdTransport do but send nothing. Frames change a growing share of the rendered
+// LEDs. Prints the average time per frame for each share next to a Leds which has not seen a
+// frame yet and so re-encodes every LED. Every frame the front buffers of both are compared
+// and the run fails on any difference.
+
+#include "../onewire.h"
+#include "../leds.h"
+#include "../ledsprepare.h"
+#include "../color.h"
+#include "../random.h"
+#include "../profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <algorithm>
+
+using slots = onewire::gpio_slots;
+
+// Rendered LEDs in Mirrored mode, ring 0 and then bird 0
+static constexpr size_t renderedN = Leds::circleLedsN + Leds::birdLedsN;
+
+// SPIRingTransport without the SPI and PDMA
+class RingTransport {
+public:
+    RingTransport() {
+        for (auto &buffer : buffers) {
+            for (auto &side : buffer) {
+                side.fill(0);
+            }
+        }
+    }
+
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encoding::encode(&buffers[back][side][index * encoding::wordsPerLed], pixel);
+    }
+
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        encode(0, index, pixel);
+        memcpy(&buffers[back][1][mirrorIndex * encoding::wordsPerLed], &buffers[back][0][index * encoding::wordsPerLed], encoding::bytesPerLed);
+    }
+
+    void copy(size_t side, size_t index) {
+        size_t last = ( back + Leds::bufferN - 1 ) % Leds::bufferN;
+        memcpy(&buffers[back][side][index * encoding::wordsPerLed], &buffers[last][side][index * encoding::wordsPerLed], encoding::bytesPerLed);
+    }
+
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        copy(0, index);
+        copy(1, mirrorIndex);
+    }
+
+    void start() {
+        back = ( back + 1 ) % Leds::bufferN;
+    }
+
+    bool operator==(const RingTransport &other) const {
+        return front() == other.front();
+    }
+
+private:
+    using encoding = onewire::encoder<onewire::protocol_of<Leds::topology::segment<Leds::circleSegment(0)>::protocol>::type, onewire::spi_nibble<32>>;
+
+    using buffer = std::array<std::array<uint32_t, Leds::circleLedsN * encoding::wordsPerLed>, Leds::sidesN>;
+
+    const buffer &front() const {
+        return buffers[( back + Leds::bufferN - 1 ) % Leds::bufferN];
+    }
+
+    std::array<buffer, Leds::bufferN> buffers;
+    size_t back = 0;
+};
+
+// GPIODMABirdTransport without the timer and PDMA
+class BirdTransport {
+public:
+    BirdTransport() {
+        for (auto &buffer : buffers) {
+            buffer.fill(0);
+            slots::prepare(buffer.data(), pinMask[0] | pinMask[1], Leds::birdLedsN * Leds::bitsPerLed);
+        }
+    }
+
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encodePins(pinMask[side], index, pixel);
+    }
+
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        if (index == mirrorIndex) {
+            encodePins(pinMask[0] | pinMask[1], index, pixel);
+        } else {
+            encodePins(pinMask[0], index, pixel);
+            encodePins(pinMask[1], mirrorIndex, pixel);
+        }
+    }
+
+    void copy(size_t side, size_t index) {
+        copyPins(pinMask[side], index);
+    }
+
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        if (index == mirrorIndex) {
+            copyPins(pinMask[0] | pinMask[1], index);
+        } else {
+            copyPins(pinMask[0], index);
+            copyPins(pinMask[1], mirrorIndex);
+        }
+    }
+
+    void start() {
+        back = ( back + 1 ) % Leds::bufferN;
+    }
+
+    bool operator==(const BirdTransport &other) const {
+        return front() == other.front();
+    }
+
+private:
+    using protocol = onewire::protocol_of<Leds::topology::segment<Leds::birdSegment(0)>::protocol>::type;
+
+    static constexpr uint32_t pinMask[Leds::sidesN] = { 1UL << 2, 1UL << 13 };
+
+    void encodePins(uint32_t mask, size_t index, const color::rgba<uint16_t> &pixel) {
+        slots::encode<protocol>(&buffers[back][index * Leds::bitsPerLed * slots::slotsPerBit], mask, pixel);
+    }
+
+    void copyPins(uint32_t mask, size_t index) {
+        size_t last = ( back + Leds::bufferN - 1 ) % Leds::bufferN;
+        slots::copy(&buffers[back][index * Leds::bitsPerLed * slots::slotsPerBit], &buffers[last][index * Leds::bitsPerLed * slots::slotsPerBit], mask, Leds::bitsPerLed);
+    }
+
+    using buffer = std::array<uint32_t, Leds::birdLedsN * Leds::bitsPerLed * slots::slotsPerBit>;
+
+    const buffer &front() const {
+        return buffers[( back + Leds::bufferN - 1 ) % Leds::bufferN];
+    }
+
+    std::array<buffer, Leds::bufferN> buffers;
+    size_t back = 0;
+};
+
+// A Leds and its transports, fed the rendered LEDs one frame at a time
+class Chain {
+public:
+    Chain() {
+        leds->setSymmetry(Leds::Mirrored);
+    }
+
+    // Returns the time markChanged() and prepare() took
+    uint32_t frame(const std::array<color::luv16, renderedN> &rendered) {
+        std::copy(rendered.begin(), rendered.begin() + Leds::circleLedsN, leds->circle(0).begin());
+        std::copy(rendered.begin() + Leds::circleLedsN, rendered.end(), leds->bird(0).begin());
+
+        uint32_t start = Profiler::now();
+        bool changed = leds->markChanged(brightness);
+        if (changed) {
+            leds->prepare(brightness, *ring, *bird);
+        }
+        uint32_t time = Profiler::now() - start;
+
+        // Like Leds::transfer(), an unchanged frame is not sent again
+        if (changed) {
+            ring->start();
+            bird->start();
+        }
+        return time;
+    }
+
+    bool operator==(const Chain &other) const {
+        return *ring == *other.ring && *bird == *other.bird;
+    }
+
+private:
+    static constexpr float brightness = 0.5f;
+
+    std::unique_ptr<Leds> leds = std::make_unique<Leds>();
+    std::unique_ptr<RingTransport> ring = std::make_unique<RingTransport>();
+    std::unique_ptr<BirdTransport> bird = std::make_unique<BirdTransport>();
+};
+
+struct Result {
+    double dirty = 0.0;
+    double full = 0.0;
+    size_t mismatches = 0;
+};
+
+// Changes count LEDs each frame, picked at random
+static Result run(size_t count, size_t framesN) {
+    Random::Stream random(0x5EED0000 + uint32_t(count));
+    std::array<color::luv16, renderedN> leds {};
+    Chain dirty;
+    Result result;
+    uint64_t dirtyTime = 0;
+    uint64_t fullTime = 0;
+    for (size_t f = 0; f < framesN; f++) {
+        std::array<size_t, renderedN> order;
+        for (size_t c = 0; c < renderedN; c++) {
+            order[c] = c;
+        }
+        for (size_t c = 0; c < count; c++) {
+            std::swap(order[c], order[c + size_t(random.get(0, int32_t(renderedN - c)))]);
+            leds[order[c]] = color::luv16(color::hsv(vector::float4(random.get(0.0f, 1.0f), random.get(0.0f, 1.0f), random.get(0.0f, 1.0f))));
+        }
+
+        dirtyTime += dirty.frame(leds);
+
+        Chain full;
+        fullTime += full.frame(leds);
+
+        if (!( dirty == full )) {
+            result.mismatches++;
+        }
+    }
+    result.dirty = double(Profiler::toMicroseconds(uint32_t(dirtyTime / std::max(framesN, size_t(1)))));
+    result.full = double(Profiler::toMicroseconds(uint32_t(fullTime / std::max(framesN, size_t(1)))));
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    size_t framesN = 2000;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-f") && c + 1 < argc) {
+            framesN = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: encode [-f frames]\n");
+            return 2;
+        }
+    }
+
+    Profiler::init();
+
+    bool ok = true;
+    printf("%zu rendered LEDs, %zu frames each\n", renderedN, framesN);
+    for (size_t percent : { 0, 5, 10, 25, 50, 75, 100 }) {
+        size_t count = ( renderedN * percent + 50 ) / 100;
+        Result result = run(count, framesN);
+        printf("%3zu%% changed: %6.2fus per frame, full re-encode %6.2fus\n", percent, result.dirty, result.full);
+        if (result.mismatches) {
+            printf("      %zu frames differ from a full encode\n", result.mismatches);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
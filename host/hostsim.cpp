@@ -0,0 +1,74 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Host side of the classes the effects touch. The LED sink keeps the composed frame in
+// Leds::frame() for the render tool to read, there are no transports.
+
+#include "../leds.h"
+#include "../model.h"
+#include "../seed.h"
+#include "../stm32wl.h"
+
+Leds &Leds::instance() {
+    static Leds leds;
+    return leds;
+}
+
+void Leds::setSymmetry(Symmetry symmetry) {
+    symmetryMode = symmetry;
+}
+
+void Leds::transfer() {
+}
+
+struct Leds::Map Leds::map;
+
+bool Model::dirty = false;
+bool Model::initialized = false;
+
+Model &Model::instance() {
+    static Model model;
+    return model;
+}
+
+Seed &Seed::instance() {
+    static Seed seed;
+    if (!seed.initialized) {
+        seed.initialized = true;
+        seed.init();
+    }
+    return seed;
+}
+
+// Fixed seed so renders are reproducible
+void Seed::init() {
+    for (size_t c = 0; c < data.size(); c++) {
+        data[c] = uint8_t(c * 73 + 41);
+    }
+}
+
+bool STM32WL::devicePresent = false;
+
+STM32WL &STM32WL::instance() {
+    static STM32WL stm32wl;
+    return stm32wl;
+}
@@ -0,0 +1,44 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef HOST_HOSTSIM_H_
+#define HOST_HOSTSIM_H_
+
+// Forced into every translation unit of the host build. Stands in for the ARM saturation
+// builtins the firmware uses.
+
+#include <cstdint>
+
+static inline uint32_t host_usat(int64_t v, int bits) {
+    const int64_t max = ( int64_t(1) << bits ) - 1;
+    return uint32_t(v < 0 ? 0 : ( v > max ? max : v ));
+}
+
+static inline int32_t host_ssat(int64_t v, int bits) {
+    const int64_t max = ( int64_t(1) << ( bits - 1 ) ) - 1;
+    return int32_t(v < -max - 1 ? -max - 1 : ( v > max ? max : v ));
+}
+
+#define __builtin_arm_usat(v, bits) host_usat(int64_t(v), bits)
+#define __builtin_arm_ssat(v, bits) host_ssat(int64_t(v), bits)
+
+#endif /* HOST_HOSTSIM_H_ */
@@ -0,0 +1,266 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Loopback for the GPIO bird transport.
+//
+//   loopback [-f frames]
+//
+// Frames of random pixels are encoded with onewire::gpio_slots the same way
+// GPIODMABirdTransport does, then played back one slot per 1/slotRate the way PDMA writes them
+// to PB->DOUT. A decoder on each pin times the high phase and period of every bit and recovers
+// the LED values. The run fails if a value differs from what went in, a bit is outside the
+// WS2816 timing window, or the waveform of an LED differs from the SPI ring encoding of the
+// same pixel.
+
+#include "../onewire.h"
+#include "../leds.h"
+#include "../random.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <algorithm>
+
+// Bit timing the decoder accepts, in ns
+static constexpr double t0hMin = 200.0;
+static constexpr double t0hMax = 380.0;
+static constexpr double t1hMin = 450.0;
+static constexpr double t1hMax = 1000.0;
+static constexpr double periodMin = 900.0;
+static constexpr double periodMax = 1500.0;
+
+using slots = onewire::gpio_slots;
+using protocol = onewire::protocol_of<Leds::topology::segment<Leds::birdSegment(0)>::protocol>::type;
+
+static constexpr uint32_t pinMask[Leds::sidesN] = { 1UL << 2, 1UL << 13 };
+
+// Same buffers and encode paths as GPIODMABirdTransport, start() hands out the front buffer
+// instead of starting PDMA
+class LoopbackBirdTransport {
+public:
+    LoopbackBirdTransport() {
+        for (auto &buffer : buffers) {
+            buffer.fill(0);
+            slots::prepare(buffer.data(), pinMask[0] | pinMask[1], Leds::birdLedsN * Leds::bitsPerLed);
+        }
+    }
+
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encodePins(pinMask[side], index, pixel);
+    }
+
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        if (index == mirrorIndex) {
+            encodePins(pinMask[0] | pinMask[1], index, pixel);
+        } else {
+            encodePins(pinMask[0], index, pixel);
+            encodePins(pinMask[1], mirrorIndex, pixel);
+        }
+    }
+
+    std::span<const uint32_t> start() {
+        auto &front = buffers[back];
+        back = ( back + 1 ) % Leds::bufferN;
+        return front;
+    }
+
+private:
+    static constexpr size_t extraPadding = 8;
+
+    void encodePins(uint32_t mask, size_t index, const color::rgba<uint16_t> &pixel) {
+        slots::encode<protocol>(&buffers[back][index * Leds::bitsPerLed * slots::slotsPerBit], mask, pixel);
+    }
+
+    std::array<std::array<uint32_t, ( Leds::birdLedsN * Leds::bitsPerLed + extraPadding ) * slots::slotsPerBit>, Leds::bufferN> buffers;
+    size_t back = 0;
+};
+
+struct Bit {
+    double high = 0.0;
+    double period = 0.0;    // 0 for the last bit, nothing follows it
+    bool value = false;
+};
+
+struct Stats {
+    size_t bits = 0;
+    size_t errors = 0;
+    double t0hMin = 1e9, t0hMax = 0.0;
+    double t1hMin = 1e9, t1hMax = 0.0;
+    double periodMin = 1e9, periodMax = 0.0;
+};
+
+// Edges of one pin, timed in ns from the first slot
+static std::vector<Bit> decode(std::span<const uint32_t> words, uint32_t mask) {
+    const double slotNs = 1e9 / double(slots::slotRate);
+    std::vector<Bit> bits;
+    bool level = false;
+    double rise = 0.0;
+    for (size_t c = 0; c <= words.size(); c++) {
+        bool high = c < words.size() && ( words[c] & mask ) != 0;
+        double t = double(c) * slotNs;
+        if (high && !level) {
+            if (!bits.empty()) {
+                bits.back().period = t - rise;
+            }
+            bits.emplace_back();
+            rise = t;
+        } else if (!high && level) {
+            bits.back().high = t - rise;
+            bits.back().value = bits.back().high > ( t0hMax + t1hMin ) * 0.5;
+        }
+        level = high;
+    }
+    return bits;
+}
+
+// Wire bits of one LED, components in order and MSB first
+static std::vector<bool> expected(const color::rgba<uint16_t> &pixel) {
+    std::vector<bool> bits;
+    protocol::order::each(protocol::fix(pixel), [&](uint16_t v) {
+        for (size_t b = 0; b < protocol::bitsPerComponent; b++) {
+            bits.push_back(( v >> ( protocol::bitsPerComponent - 1 - b ) ) & 1);
+        }
+    });
+    return bits;
+}
+
+// Line levels of one LED on the SPI ring wire, one per SPI bit
+static std::vector<bool> spiLevels(const color::rgba<uint16_t> &pixel) {
+    using encoding = onewire::encoder<protocol, onewire::spi_nibble<8>>;
+    uint32_t words[encoding::wordsPerLed];
+    encoding::encode(words, pixel);
+    std::vector<bool> levels;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(words);
+    for (size_t c = 0; c < encoding::bytesPerLed; c++) {
+        for (size_t b = 0; b < 8; b++) {
+            levels.push_back(( bytes[c] >> ( 7 - b ) ) & 1);
+        }
+    }
+    return levels;
+}
+
+static void check(std::span<const uint32_t> words, uint32_t mask, const std::vector<color::rgba<uint16_t>> &pixels, Stats &stats) {
+    std::vector<Bit> bits = decode(words, mask);
+    if (bits.size() != pixels.size() * Leds::bitsPerLed) {
+        printf("pin %04x: %zu bits, expected %zu\n", (unsigned)mask, bits.size(), pixels.size() * Leds::bitsPerLed);
+        stats.errors++;
+        return;
+    }
+    for (size_t l = 0; l < pixels.size(); l++) {
+        std::vector<bool> want = expected(pixels[l]);
+        std::vector<bool> spi = spiLevels(pixels[l]);
+        for (size_t b = 0; b < Leds::bitsPerLed; b++) {
+            const Bit &bit = bits[l * Leds::bitsPerLed + b];
+            stats.bits++;
+            bool timing = true;
+            if (bit.value) {
+                stats.t1hMin = std::min(stats.t1hMin, bit.high);
+                stats.t1hMax = std::max(stats.t1hMax, bit.high);
+                timing = bit.high >= t1hMin && bit.high <= t1hMax;
+            } else {
+                stats.t0hMin = std::min(stats.t0hMin, bit.high);
+                stats.t0hMax = std::max(stats.t0hMax, bit.high);
+                timing = bit.high >= t0hMin && bit.high <= t0hMax;
+            }
+            if (bit.period > 0.0) {
+                stats.periodMin = std::min(stats.periodMin, bit.period);
+                stats.periodMax = std::max(stats.periodMax, bit.period);
+                timing &= bit.period >= periodMin && bit.period <= periodMax;
+            }
+            if (!timing || bit.value != want[b]) {
+                if (stats.errors++ < 8) {
+                    printf("pin %04x led %zu bit %zu: %d, expected %d, high %.0fns period %.0fns\n",
+                        (unsigned)mask, l, b, int(bit.value), int(want[b]), bit.high, bit.period);
+                }
+            }
+        }
+        // Slot for slot the same line levels as the SPI ring
+        const uint32_t *led = &words[l * Leds::bitsPerLed * slots::slotsPerBit];
+        for (size_t s = 0; s < spi.size(); s++) {
+            if (( ( led[s] & mask ) != 0 ) != spi[s]) {
+                if (stats.errors++ < 8) {
+                    printf("pin %04x led %zu slot %zu differs from SPI\n", (unsigned)mask, l, s);
+                }
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t framesN = 16;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-f") && c + 1 < argc) {
+            framesN = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: loopback [-f frames]\n");
+            return 2;
+        }
+    }
+
+    static_assert(slots::slotsPerBit * 8 == 32, "one spi_nibble word per byte");
+
+    Random::Stream random(0x10091009);
+    LoopbackBirdTransport transport;
+    Stats stats;
+    std::vector<color::rgba<uint16_t>> pixels[Leds::sidesN];
+    for (auto &side : pixels) {
+        side.resize(Leds::birdLedsN);
+    }
+
+    for (size_t f = 0; f < framesN; f++) {
+        // Plain, mirrored in place and mirrored reversed, like the three paths in Leds::prepare()
+        size_t mode = f % 3;
+        for (size_t c = 0; c < Leds::birdLedsN; c++) {
+            color::rgba<uint16_t> pixel(uint16_t(random.get()), uint16_t(random.get()), uint16_t(random.get()));
+            // Some dark and some saturated values, where fix_for_ws2816 and the edges are busiest
+            if (( c % 5 ) == 0) {
+                pixel = color::rgba<uint16_t>(uint16_t(random.get() % 512), 0, 0xFFFF);
+            }
+            if (mode == 0) {
+                pixels[0][c] = pixel;
+                pixels[1][c] = color::rgba<uint16_t>(uint16_t(random.get()), uint16_t(random.get()), uint16_t(random.get()));
+                transport.encode(0, c, pixels[0][c]);
+                transport.encode(1, c, pixels[1][c]);
+            } else {
+                size_t mirror = mode == 1 ? c : Leds::birdLedsN - 1 - c;
+                pixels[0][c] = pixel;
+                pixels[1][mirror] = pixel;
+                transport.encodeMirrored(c, mirror, pixel);
+            }
+        }
+        std::span<const uint32_t> front = transport.start();
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            check(front, pinMask[s], pixels[s], stats);
+        }
+    }
+
+    printf("%zu frames, %zu bits: T0H %.0f-%.0fns T1H %.0f-%.0fns period %.0f-%.0fns\n",
+        framesN, stats.bits, stats.t0hMin, stats.t0hMax, stats.t1hMin, stats.t1hMax, stats.periodMin, stats.periodMax);
+    if (stats.errors) {
+        printf("%zu errors\n", stats.errors);
+        return 1;
+    }
+    return 0;
+}
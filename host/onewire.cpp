@@ -0,0 +1,183 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Host test of the onewire.h encoders.
+//
+//   onewire [-n pixels]
+//
+// Every protocol, wire and component order combination encodes random pixels, plus black,
+// white and values around the ws2816 low level fixup. A decoder which only knows the wire
+// format turns the output back into line bits and component values, and the run fails if
+// they differ from the pixel after the protocol fixup, or if a symbol is not a valid zero or
+// one of the wire.
+
+#include "../onewire.h"
+#include "../random.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+template<class Order> struct indices;
+template<size_t... C> struct indices<onewire::order<C...>> {
+    static constexpr size_t list[] = { C... };
+};
+
+// Expected values, written out here rather than taken from onewire.h
+static uint16_t component(const color::rgba<uint16_t> &pixel, size_t index) {
+    switch (index) {
+        case 0: return pixel.r;
+        case 1: return pixel.g;
+        case 2: return pixel.b;
+        default: return pixel.a;
+    }
+}
+
+template<class Protocol> static uint16_t fixed(uint16_t v) {
+    if constexpr (std::is_same_v<Protocol, onewire::ws2816>) {
+        return v < 384 ? uint16_t(( v * 256 ) / 384) : v;
+    }
+    return v;
+}
+
+// Line bits of a wire, -1 for a symbol which is neither a zero nor a one
+template<class Wire> struct decoder;
+
+template<> struct decoder<onewire::spi_nibble<8>> {
+    static std::vector<int> bits(const std::vector<uint32_t> &words) {
+        std::vector<int> out;
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(words.data());
+        for (size_t c = 0; c < words.size() * 4; c++) {
+            for (size_t n = 0; n < 2; n++) {
+                uint8_t nibble = ( bytes[c] >> ( 4 - n * 4 ) ) & 0xF;
+                out.push_back(nibble == 0x8 ? 0 : nibble == 0xC ? 1 : -1);
+            }
+        }
+        return out;
+    }
+};
+
+// 32-bit SPI frames shift out MSB first
+template<> struct decoder<onewire::spi_nibble<32>> {
+    static std::vector<int> bits(const std::vector<uint32_t> &words) {
+        std::vector<int> out;
+        for (uint32_t word : words) {
+            for (size_t n = 0; n < 8; n++) {
+                uint32_t nibble = ( word >> ( 28 - n * 4 ) ) & 0xF;
+                out.push_back(nibble == 0x8 ? 0 : nibble == 0xC ? 1 : -1);
+            }
+        }
+        return out;
+    }
+};
+
+template<> struct decoder<onewire::pwm_duty> {
+    static std::vector<int> bits(const std::vector<uint32_t> &words) {
+        std::vector<int> out;
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(words.data());
+        for (size_t c = 0; c < words.size() * 4; c++) {
+            out.push_back(bytes[c] == onewire::pwm_duty::zero ? 0 : bytes[c] == onewire::pwm_duty::one ? 1 : -1);
+        }
+        return out;
+    }
+};
+
+template<class Protocol, class Wire, class Order = typename Protocol::order>
+static size_t check(const char *name, const std::vector<color::rgba<uint16_t>> &pixels) {
+    using encoding = onewire::encoder<Protocol, Wire, Order>;
+    const auto &order = indices<Order>::list;
+
+    std::vector<uint32_t> words(pixels.size() * encoding::wordsPerLed);
+    uint32_t *p = words.data();
+    for (const auto &pixel : pixels) {
+        p = encoding::encode(p, pixel);
+    }
+    if (p != words.data() + words.size()) {
+        printf("%s: wrote %zu words, expected %zu\n", name, size_t(p - words.data()), words.size());
+        return 1;
+    }
+
+    std::vector<int> bits = decoder<Wire>::bits(words);
+    size_t errors = 0;
+    size_t bit = 0;
+    for (size_t l = 0; l < pixels.size(); l++) {
+        for (size_t index : order) {
+            uint16_t want = fixed<Protocol>(component(pixels[l], index)) >> ( 16 - Protocol::bitsPerComponent );
+            int32_t got = 0;
+            for (size_t b = 0; b < Protocol::bitsPerComponent; b++, bit++) {
+                got = bits[bit] < 0 ? -1 : got < 0 ? got : ( got << 1 ) | bits[bit];
+            }
+            if (got != int32_t(want) && errors++ < 4) {
+                printf("%s: LED %zu component %zu decoded %d, expected %u\n", name, l, index, int(got), unsigned(want));
+            }
+        }
+    }
+    if (bit != bits.size()) {
+        printf("%s: %zu line bits, expected %zu\n", name, bits.size(), bit);
+        errors++;
+    }
+    printf("%-28s %3zu words per LED, %s\n", name, encoding::wordsPerLed, errors ? "FAILED" : "ok");
+    return errors;
+}
+
+template<class Protocol> static size_t checkWires(const char *protocol, const std::vector<color::rgba<uint16_t>> &pixels) {
+    std::string p(protocol);
+    size_t errors = 0;
+    errors += check<Protocol, onewire::spi_nibble<8>>((p + " spi8").c_str(), pixels);
+    errors += check<Protocol, onewire::spi_nibble<32>>((p + " spi32").c_str(), pixels);
+    errors += check<Protocol, onewire::pwm_duty>((p + " pwm").c_str(), pixels);
+    errors += check<Protocol, onewire::spi_nibble<32>, onewire::rgb>((p + " spi32 rgb").c_str(), pixels);
+    errors += check<Protocol, onewire::pwm_duty, onewire::grbw>((p + " pwm grbw").c_str(), pixels);
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    size_t pixelsN = 4096;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-n") && c + 1 < argc) {
+            pixelsN = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: onewire [-n pixels]\n");
+            return 2;
+        }
+    }
+
+    std::vector<color::rgba<uint16_t>> pixels;
+    pixels.emplace_back(0, 0, 0, 0);
+    pixels.emplace_back(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+    for (uint16_t v = 380; v < 390; v++) {
+        pixels.emplace_back(v, uint16_t(v - 256), uint16_t(v + 256), uint16_t(v / 2));
+    }
+    Random::Stream random(0x0E1E0000);
+    while (pixels.size() < pixelsN) {
+        pixels.emplace_back(uint16_t(random.get()), uint16_t(random.get()), uint16_t(random.get()), uint16_t(random.get()));
+    }
+
+    size_t errors = 0;
+    errors += checkWires<onewire::ws2812>("ws2812", pixels);
+    errors += checkWires<onewire::ws2816>("ws2816", pixels);
+    errors += checkWires<onewire::sk6812>("sk6812", pixels);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Host test of the palettes.txt parser and of runtime gradients from odd stop lists.
+//
+//   palette
+//
+// Lines which Palettes::parseLine() has to accept and ones it has to reject, like positions
+// which are unsorted, repeated, do not start at 0 or do not end at 255. Then gradients built
+// through Palettes::get() from repeated and out of range stops, which have to come out as the
+// end colors rather than NaN.
+
+#include "../palette.h"
+#include "../color.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+struct Line {
+    const char *text;
+    bool valid;
+};
+
+static constexpr Line lines[] = {
+    { "ff0000@0 00ff00@128 0000ff@255",     true },
+    { "000000@0 FFFFFF@255",                true },
+    { "  ff0000@0\t00ff00@255  # comment",  true },
+    { "ff0000@0 00ff00@255 0000ff@255",     false },    // repeated
+    { "ff0000@0 00ff00@200 0000ff@100 ffffff@255", false }, // unsorted
+    { "ff0000@10 0000ff@255",               false },    // does not start at 0
+    { "ff0000@0 0000ff@254",                false },    // does not end at 255
+    { "ff0000@0 0000ff@256",                false },    // out of range
+    { "ff0000@0 0000ff@0000000255",         false },    // too many digits
+    { "ff0000@0 0000ff@4294967551",         false },    // wraps to 255 in 32 bits
+    { "ff0000@0",                           false },    // single stop
+    { "ff00@0 0000ff@255",                  false },    // short color
+    { "ff0000 0000ff@255",                  false },    // no position
+    { "ff0000@0 0000ff@",                   false },
+    { "# ff0000@0 0000ff@255",              false },
+    { "",                                   false },
+    { "000000@0 111111@1 222222@2 333333@3 444444@4 555555@5 666666@6 777777@7 888888@255", false }, // too many stops
+};
+
+static bool same(const vector::float4 &a, const vector::float4 &b) {
+    return std::fabs(a.x - b.x) < 1e-3f && std::fabs(a.y - b.y) < 1e-3f && std::fabs(a.z - b.z) < 1e-3f;
+}
+
+int main() {
+    size_t errors = 0;
+
+    size_t accepted = 0;
+    for (const Line &line : lines) {
+        bool ok = Palettes::instance().parseLine(line.text, strlen(line.text));
+        accepted += ok;
+        if (ok != line.valid) {
+            printf("\"%s\": %s, expected %s\n", line.text, ok ? "accepted" : "rejected", line.valid ? "accepted" : "rejected");
+            errors++;
+        }
+    }
+    if (Palettes::instance().fileCount() != accepted) {
+        printf("%zu palettes, expected %zu\n", Palettes::instance().fileCount(), accepted);
+        errors++;
+    }
+
+    // Runtime stops are not checked, the gradient has to cope
+    const vector::float4 red(color::srgb8({0xff, 0x00, 0x00}));
+    const vector::float4 blue(color::srgb8({0x00, 0x00, 0xff}));
+    const Palettes::stop repeated[] = { { 0xff0000, 0.5f }, { 0x0000ff, 0.5f } };
+    const Palettes::stop inside[] = { { 0xff0000, 0.25f }, { 0x0000ff, 0.75f } };
+    const Palettes::stop outside[] = { { 0xff0000, -1.0f }, { 0x0000ff, 2.0f } };
+    struct Case {
+        const char *name;
+        std::span<const Palettes::stop> stops;
+    } cases[] = {
+        { "repeated", repeated },
+        { "inside", inside },
+        { "outside", outside },
+    };
+    for (const Case &c : cases) {
+        const color::gradient &g = Palettes::instance().get(c.stops);
+        bool finite = true;
+        for (size_t i = 0; i <= 256; i++) {
+            vector::float4 v = g.clamp(float(i) / 256.0f);
+            finite &= std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+        }
+        vector::float4 first = g.clamp(0.0f);
+        vector::float4 last = g.clamp(1.0f);
+        // Out of range stops are cut off, the ends are somewhere between the two colors
+        bool ends = c.stops.data() == outside ? true : same(first, red) && same(last, blue);
+        if (!finite || !ends) {
+            printf("%s stops: %s\n", c.name, finite ? "wrong end colors" : "not finite");
+            errors++;
+        }
+    }
+
+    printf("%zu lines, %zu palettes, %zu errors\n", std::size(lines), accepted, errors);
+    return errors ? 1 : 0;
+}
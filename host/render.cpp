@@ -0,0 +1,265 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Renders every effect off-device on a simulated clock.
+//
+//   render [-s seconds] [-e effect] [-f ppm|csv|none] [-o dir] [-c checksums] [-p palettes]
+//
+// Each effect runs for the given number of seconds at Timeline::effectRate, starting with the
+// crossfade from the previous one. Frames are written as one PPM per effect, one row per frame,
+// or as CSV. For every effect the tool prints a checksum over all frames and the average and
+// worst time per frame. With -c the checksums are compared against a file of
+// "<checksum> <effect name>" lines as printed, and the exit code is 1 on any mismatch. Effects
+// carry state over from the ones before, so checksums only compare between runs with the same
+// -s, -e and -p. With -p palettes are loaded from a file as they would be from the SD card.
+// render_function is the same tool with USE_FUNCTION_KERNELS, run both for before and after
+// timings of the effect kernels.
+
+#include "../effects.h"
+#include "../timeline.h"
+#include "../leds.h"
+#include "../model.h"
+#include "../color.h"
+#include "../profiler.h"
+#include "../palette.h"
+#include "../frame.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+enum Format {
+    PPM,
+    CSV,
+    None
+};
+
+struct Options {
+    double seconds = 5.0;
+    int effect = -1;
+    Format format = PPM;
+    std::string outDir = ".";
+    std::string checksums;
+    std::string palettes;
+};
+
+static void usage() {
+    fprintf(stderr, "usage: render [-s seconds] [-e effect] [-f ppm|csv|none] [-o dir] [-c checksums] [-p palettes]\n");
+    exit(2);
+}
+
+static Options parse(int argc, char *argv[]) {
+    Options options;
+    for (int c = 1; c < argc; c++) {
+        auto arg = [&]() {
+            if (c + 1 >= argc) {
+                usage();
+            }
+            return argv[++c];
+        };
+        if (!strcmp(argv[c], "-s")) {
+            options.seconds = atof(arg());
+        } else if (!strcmp(argv[c], "-e")) {
+            options.effect = atoi(arg());
+        } else if (!strcmp(argv[c], "-f")) {
+            const char *f = arg();
+            if (!strcmp(f, "ppm")) {
+                options.format = PPM;
+            } else if (!strcmp(f, "csv")) {
+                options.format = CSV;
+            } else if (!strcmp(f, "none")) {
+                options.format = None;
+            } else {
+                usage();
+            }
+        } else if (!strcmp(argv[c], "-o")) {
+            options.outDir = arg();
+        } else if (!strcmp(argv[c], "-c")) {
+            options.checksums = arg();
+        } else if (!strcmp(argv[c], "-p")) {
+            options.palettes = arg();
+        } else {
+            usage();
+        }
+    }
+    return options;
+}
+
+// sRGB8 of the LEDs which are actually rendered, side 0 only in mirrored mode
+static void capture(std::vector<uint8_t> &out) {
+    static const color::convert converter;
+    auto frame = Leds::instance().frame();
+    size_t sides = Leds::instance().symmetry() == Leds::Mirrored ? 1 : Leds::sidesN;
+    auto add = [&](size_t index) {
+        color::rgba<uint16_t> rgb = converter.CIELUV2sRGB16(vector::float4(frame[index]));
+        out.push_back(uint8_t(rgb.r >> 8));
+        out.push_back(uint8_t(rgb.g >> 8));
+        out.push_back(uint8_t(rgb.b >> 8));
+    };
+    for (size_t s = 0; s < sides; s++) {
+        for (size_t c = 0; c < Leds::circleLedsN; c++) {
+            add(Leds::topology::index(Leds::circleSegment(s), c));
+        }
+        for (size_t c = 0; c < Leds::birdLedsN; c++) {
+            add(Leds::topology::index(Leds::birdSegment(s), c));
+        }
+    }
+}
+
+static uint32_t fnv1a(const std::vector<uint8_t> &data) {
+    uint32_t h = 0x811C9DC5UL;
+    for (uint8_t b : data) {
+        h ^= b;
+        h *= 0x01000193UL;
+    }
+    return h;
+}
+
+static std::string fileName(const Options &options, size_t effect, const char *ext) {
+    std::string name(Effects::name(effect));
+    std::replace(name.begin(), name.end(), ' ', '_');
+    return options.outDir + "/" + std::to_string(effect) + "_" + name + "." + ext;
+}
+
+static bool write(const Options &options, size_t effect, const std::vector<uint8_t> &pixels, size_t frames) {
+    if (options.format == None || frames == 0) {
+        return true;
+    }
+    size_t width = pixels.size() / 3 / frames;
+    std::string name = fileName(options, effect, options.format == PPM ? "ppm" : "csv");
+    FILE *f = fopen(name.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "render: can not write %s\n", name.c_str());
+        return false;
+    }
+    if (options.format == PPM) {
+        fprintf(f, "P6\n%zu %zu\n255\n", width, frames);
+        fwrite(pixels.data(), 1, pixels.size(), f);
+    } else {
+        fprintf(f, "frame,led,r,g,b\n");
+        for (size_t c = 0; c < pixels.size() / 3; c++) {
+            fprintf(f, "%zu,%zu,%u,%u,%u\n", c / width, c % width, pixels[c * 3 + 0], pixels[c * 3 + 1], pixels[c * 3 + 2]);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Checksum expected for an effect, 0 if the file does not list it
+static uint32_t expected(const Options &options, size_t effect) {
+    FILE *f = fopen(options.checksums.c_str(), "r");
+    if (!f) {
+        fprintf(stderr, "render: can not read %s\n", options.checksums.c_str());
+        exit(2);
+    }
+    char line[256];
+    uint32_t result = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char name[224] = {};
+        unsigned int sum = 0;
+        if (sscanf(line, "%x %223[^\n]", &sum, name) == 2 && !strcmp(name, Effects::name(effect))) {
+            result = sum;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+// Same line format as palettes.txt on the SD card
+static void loadPalettes(const Options &options) {
+    FILE *f = fopen(options.palettes.c_str(), "r");
+    if (!f) {
+        fprintf(stderr, "render: can not read %s\n", options.palettes.c_str());
+        exit(2);
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        Palettes::instance().parseLine(line, strcspn(line, "\r\n"));
+    }
+    fclose(f);
+    printf("%d palettes\n", int(Palettes::instance().fileCount()));
+}
+
+int main(int argc, char *argv[]) {
+    Options options = parse(argc, argv);
+
+    if (!options.palettes.empty()) {
+        loadPalettes(options);
+    }
+
+    Profiler::init();
+    Timeline::instance();
+    Effects::instance();
+
+    const size_t framesN = size_t(options.seconds * Timeline::effectRate);
+
+    bool ok = true;
+    uint64_t clock = 0;
+    FrameClock effectClock;
+    for (size_t e = 0; e < Effects::effectsN; e++) {
+        if (options.effect >= 0 && size_t(options.effect) != e) {
+            continue;
+        }
+
+        Model::instance().SetEffect(uint32_t(e));
+
+        std::vector<uint8_t> pixels;
+        uint64_t total = 0;
+        uint32_t worst = 0;
+        for (size_t frame = 0; frame < framesN; frame++) {
+            clock++;
+            Timeline::SetHostTime(Timeline::Ticks(double(clock) / Timeline::effectRate));
+            uint32_t start = Profiler::now();
+            // Same steps as the effect part of Pendant::Run()
+            Timeline::instance().ProcessInterval();
+            Timeline::instance().ProcessEffect();
+            if (Timeline::instance().TopEffect().Valid()) {
+                Timeline::instance().TopEffect().Calc(effectClock.capture());
+                Timeline::instance().TopEffect().Commit();
+            }
+            uint32_t time = Profiler::now() - start;
+            total += time;
+            worst = std::max(worst, time);
+            capture(pixels);
+        }
+
+        uint32_t sum = fnv1a(pixels);
+        printf("%08x %s\n", (unsigned)sum, Effects::name(e));
+        printf("         %zu frames, avg %.1fus worst %.1fus\n", framesN,
+            double(Profiler::toMicroseconds(uint32_t(total / std::max(framesN, size_t(1))))), double(Profiler::toMicroseconds(worst)));
+
+        ok &= write(options, e, pixels, framesN);
+
+        if (!options.checksums.empty()) {
+            uint32_t want = expected(options, e);
+            if (want != sum) {
+                printf("         MISMATCH, expected %08x\n", (unsigned)want);
+                ok = false;
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
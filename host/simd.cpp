@@ -0,0 +1,160 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Host test of the simd.h kernels against float math.
+//
+//   simd [-n samples]
+//
+// The shim operations of simd::reference are checked against their definitions on edge values,
+// then lerp, add and multiply run on random and edge case luv16 values, with random and edge
+// case q15 weights for lerp. Results are compared against the same blend done in double on the
+// unpacked values: lerp has to be within 1 LSB, add and multiply have to match exactly. On the
+// target simd::native is simd::dsp and runs the same kernels on the DSP instructions.
+
+#include "../simd.h"
+#include "../random.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+static constexpr int16_t edges[] = { INT16_MIN, INT16_MIN + 1, -8192, -1, 0, 1, 8191, 8192, INT16_MAX - 1, INT16_MAX };
+
+static int32_t clamp16(double v) {
+    return int32_t(std::clamp(v, double(INT16_MIN), double(INT16_MAX)));
+}
+
+struct Check {
+    const char *name;
+    int32_t tolerance;
+    size_t count = 0;
+    size_t errors = 0;
+    int32_t worst = 0;
+
+    void operator()(int32_t got, int32_t want) {
+        count++;
+        int32_t d = std::abs(got - want);
+        worst = std::max(worst, d);
+        if (d > tolerance && errors++ < 4) {
+            printf("%s: %d, expected %d\n", name, int(got), int(want));
+        }
+    }
+
+    bool report() const {
+        printf("%-8s %8zu values: worst %d LSB, %s\n", name, count, int(worst), errors ? "FAILED" : "ok");
+        return errors == 0;
+    }
+};
+
+static bool shim() {
+    using ops = simd::reference;
+    Check pack { "pack16", 0 };
+    Check qadd16 { "qadd16", 0 };
+    Check smlad { "smlad", 0 };
+    for (int16_t a : edges) {
+        for (int16_t b : edges) {
+            uint32_t p = ops::pack16(a, b);
+            pack(ops::lo16(p), a);
+            pack(ops::hi16(p), b);
+            uint32_t q = ops::qadd16(ops::pack16(a, b), ops::pack16(b, a));
+            qadd16(ops::lo16(q), clamp16(double(a) + b));
+            qadd16(ops::hi16(q), clamp16(double(b) + a));
+            // Both products at their extremes still fit, SMLAD only overflows on -32768 * -32768 twice
+            if (a != INT16_MIN || b != INT16_MIN) {
+                smlad(ops::smlad(ops::pack16(a, b), ops::pack16(b, a), 1 << 14), int32_t(int64_t(a) * b * 2 + ( 1 << 14 )));
+            }
+        }
+    }
+    bool ok = pack.report();
+    ok &= qadd16.report();
+    ok &= smlad.report();
+    return ok;
+}
+
+static color::luv16 luv(int16_t l, int16_t u, int16_t v) {
+    color::luv16 c;
+    c.l = l;
+    c.u = u;
+    c.v = v;
+    return c;
+}
+
+int main(int argc, char *argv[]) {
+    size_t samplesN = 200000;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-n") && c + 1 < argc) {
+            samplesN = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: simd [-n samples]\n");
+            return 2;
+        }
+    }
+
+    bool ok = shim();
+
+    Random::Stream random(0x51AD0000);
+    std::vector<color::luv16> values;
+    for (int16_t l : edges) {
+        for (int16_t u : edges) {
+            values.push_back(luv(l, u, int16_t(-u)));
+        }
+    }
+    while (values.size() < samplesN) {
+        values.push_back(luv(int16_t(random.get()), int16_t(random.get()), int16_t(random.get())));
+    }
+
+    Check lerp { "lerp", 1 };
+    Check add { "add", 0 };
+    Check multiply { "multiply", 0 };
+    const int32_t weights[] = { 1, 2, 16384, simd::q15One - 2, simd::q15One - 1 };
+    for (size_t c = 0; c < values.size(); c++) {
+        const color::luv16 &a = values[c];
+        const color::luv16 &b = values[( c * 7919 + 1 ) % values.size()];
+        int32_t t = c < std::size(weights) * 16 ? weights[c % std::size(weights)] : random.get(1, simd::q15One);
+        double tf = double(t) / double(simd::q15One);
+
+        color::luv16 r = simd::lerp<simd::reference>(a, b, t);
+        lerp(r.l, int32_t(std::lround(a.l + ( double(b.l) - a.l ) * tf)));
+        lerp(r.u, int32_t(std::lround(a.u + ( double(b.u) - a.u ) * tf)));
+        lerp(r.v, int32_t(std::lround(a.v + ( double(b.v) - a.v ) * tf)));
+
+        r = simd::add<simd::reference>(a, b);
+        add(r.l, clamp16(double(a.l) + b.l));
+        add(r.u, clamp16(double(a.u) + b.u));
+        add(r.v, clamp16(double(a.v) + b.v));
+
+        // The kernel truncates towards minus infinity like the shift it is
+        const double scale = 1.0 / double(1 << color::luv16::fractionBits);
+        r = simd::multiply<simd::reference>(a, b);
+        multiply(r.l, clamp16(std::floor(double(a.l) * b.l * scale)));
+        multiply(r.u, clamp16(std::floor(double(a.u) * b.l * scale)));
+        multiply(r.v, clamp16(std::floor(double(a.v) * b.l * scale)));
+    }
+    ok &= lerp.report();
+    ok &= add.report();
+    ok &= multiply.report();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Stress test for the Timeline queues on a simulated clock.
+//
+//   spans [-n spans] [-s seconds]
+//
+// Schedules growing numbers of spans, up to the given count, and runs the timeline part of
+// Pendant::Run() for the given number of seconds at each count. Most spans wait far in the
+// future, some run forever below the top effect and some are intervals which fire now and then.
+// A short display span comes and goes every second on top of the main display, the way the UI
+// transitions do. Prints the size of each span type, then the average and worst time per frame
+// for each count, neither should grow with the number of spans. Fails when the transition does
+// not find the main display below it.
+
+#include "../timeline.h"
+#include "../profiler.h"
+#include "../frame.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+
+struct Options {
+    size_t spans = 4096;
+    double seconds = 10.0;
+};
+
+static void usage() {
+    fprintf(stderr, "usage: spans [-n spans] [-s seconds]\n");
+    exit(2);
+}
+
+static Options parse(int argc, char *argv[]) {
+    Options options;
+    for (int c = 1; c < argc; c++) {
+        auto arg = [&]() {
+            if (c + 1 >= argc) {
+                usage();
+            }
+            return argv[++c];
+        };
+        if (!strcmp(argv[c], "-n")) {
+            options.spans = size_t(atol(arg()));
+        } else if (!strcmp(argv[c], "-s")) {
+            options.seconds = atof(arg());
+        } else {
+            usage();
+        }
+    }
+    return options;
+}
+
+// Spans must not move once added, deques keep them in place
+static std::deque<Timeline::Effect> effects;
+static std::deque<Timeline::Display> displays;
+static std::deque<Timeline::Interval> intervals;
+
+static uint32_t calcs = 0;
+// Calcs of the main display reached through the transition on top, and how often the
+// transition found something else below it
+static uint32_t belowCalcs = 0;
+static uint32_t wrongBelow = 0;
+
+static void add(size_t index, Timeline::ticks now) {
+    auto calc = [](Timeline::Span &, const FrameContext &) {
+        calcs++;
+    };
+    switch (index % 4) {
+        case 0: {
+            // Running forever, below the main effect
+            Timeline::Effect &effect = effects.emplace_back();
+            effect.time = now;
+            effect.duration = Timeline::forever;
+            effect.priority = -1;
+            effect.calcFunc = calc;
+            Timeline::instance().Add(effect);
+        } break;
+        case 1: {
+            // Fires once every one to ten minutes
+            Timeline::Interval &interval = intervals.emplace_back();
+            interval.interval = Timeline::Ticks(60.0 + double(index % 541));
+            interval.intervalFuzz = Timeline::Ticks(1.0);
+            interval.time = now + interval.interval;
+            interval.duration = Timeline::Ticks(0.1);
+            Timeline::instance().Add(interval);
+        } break;
+        case 2: {
+            // Not due within the run
+            Timeline::Effect &effect = effects.emplace_back();
+            effect.time = now + Timeline::Ticks(3600.0) + index;
+            effect.duration = Timeline::Ticks(1.0);
+            effect.calcFunc = calc;
+            Timeline::instance().Add(effect);
+        } break;
+        case 3: {
+            Timeline::Display &display = displays.emplace_back();
+            display.time = now + Timeline::Ticks(3600.0) + index;
+            display.duration = Timeline::Ticks(1.0);
+            display.calcFunc = calc;
+            Timeline::instance().Add(display);
+        } break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options = parse(argc, argv);
+
+    Profiler::init();
+    Timeline::instance();
+
+    printf("Span %zu, Effect %zu, Display %zu, Interval %zu bytes\n",
+        sizeof(Timeline::Span), sizeof(Timeline::Effect), sizeof(Timeline::Display), sizeof(Timeline::Interval));
+
+    const size_t framesN = size_t(options.seconds * Timeline::effectRate);
+
+    uint64_t clock = 0;
+    auto now = [&]() { return Timeline::Ticks(double(clock) / Timeline::effectRate); };
+
+    static Timeline::Effect mainEffect;
+    mainEffect.time = now();
+    mainEffect.duration = Timeline::forever;
+    mainEffect.priority = 1;
+    mainEffect.calcFunc = [](Timeline::Span &, const FrameContext &) {
+        calcs++;
+    };
+    Timeline::instance().Add(mainEffect);
+
+    static Timeline::Display mainDisplay;
+    mainDisplay.time = now();
+    mainDisplay.duration = Timeline::forever;
+    mainDisplay.calcFunc = [](Timeline::Span &span, const FrameContext &) {
+        calcs++;
+        if (&Timeline::instance().TopDisplay() != &span) {
+            belowCalcs++;
+        }
+    };
+    Timeline::instance().Add(mainDisplay);
+
+    static Timeline::Display transition;
+    transition.duration = Timeline::Ticks(0.25);
+    // Only the transition looks below itself, none of the other spans pay for the lookup
+    transition.calcFunc = [](Timeline::Span &span, const FrameContext &frame) {
+        Timeline::Span &below = span.Below();
+        if (&below != &mainDisplay) {
+            wrongBelow++;
+        }
+        below.Calc(frame);
+    };
+
+    FrameClock effectClock;
+    FrameClock displayClock;
+    size_t added = 0;
+    for (size_t count = 16; count <= std::max(options.spans, size_t(16)); count *= 4) {
+        count = std::min(count, options.spans);
+        for (; added < count; added++) {
+            add(added, now());
+        }
+
+        uint64_t total = 0;
+        uint32_t worst = 0;
+        for (size_t frame = 0; frame < framesN; frame++) {
+            clock++;
+            Timeline::SetHostTime(now());
+            if (frame % size_t(Timeline::effectRate) == 0) {
+                transition.time = now();
+                Timeline::instance().Add(transition);
+            }
+            uint32_t start = Profiler::now();
+            // Same steps as Pendant::Run(), display at every frame
+            Timeline::instance().ProcessInterval();
+            Timeline::instance().ProcessEffect();
+            if (Timeline::instance().TopEffect().Valid()) {
+                Timeline::instance().TopEffect().Calc(effectClock.capture());
+            }
+            Timeline::instance().ProcessDisplay();
+            if (Timeline::instance().TopDisplay().Valid()) {
+                Timeline::instance().TopDisplay().Calc(displayClock.capture());
+            }
+            uint32_t time = Profiler::now() - start;
+            total += time;
+            worst = std::max(worst, time);
+        }
+
+        printf("%6zu spans: avg %.2fus worst %.2fus\n", count,
+            double(Profiler::toMicroseconds(uint32_t(total / std::max(framesN, size_t(1))))), double(Profiler::toMicroseconds(worst)));
+
+        if (count == options.spans) {
+            break;
+        }
+    }
+
+    printf("%u calcs, %u of them below the transition\n", (unsigned)calcs, (unsigned)belowCalcs);
+    if (wrongBelow || !belowCalcs) {
+        printf("transition found the wrong span below it %u times\n", (unsigned)wrongBelow);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Host test of the chunked SPI stream against a simulated PDMA.
+//
+//   stream [-n leds]
+//
+// For every chain length up to the given count, frames of random pixels go through
+// ledstream::chunked the way SPIStreamRingTransport drives it. The simulated PDMA copies one
+// word per channel and step into the SPI TX stream of that channel and raises the completion
+// interrupt when a transfer is done. The interrupt handler follows pdmaDone(): it takes the next
+// chunk, starts it and only then refills the chunk which went out, so a refill which touched a
+// chunk still in flight shows up in the stream. Both channels run at once with different
+// lengths. The run fails if a stream differs from the whole frame encoded in one go, or if any
+// LED was encoded other than once per frame.
+
+#include "../ledstream.h"
+#include "../onewire.h"
+#include "../leds.h"
+#include "../random.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <algorithm>
+
+using encoding = onewire::encoder<onewire::protocol_of<Leds::topology::segment<Leds::circleSegment(0)>::protocol>::type, onewire::spi_nibble<32>>;
+
+static constexpr size_t chunkLedsN = 16;
+static constexpr size_t channelsN = 2;
+
+struct Channel {
+    std::span<const uint32_t> src;
+    size_t pos = 0;
+    bool busy = false;
+    std::vector<uint32_t> tx;
+};
+
+struct Encoder {
+    const std::vector<color::rgba<uint16_t>> &pixels;
+    std::vector<size_t> &encodes;
+
+    void operator()(uint32_t *p, size_t index) const {
+        encodes[index]++;
+        encoding::encode(p, pixels[index]);
+    }
+};
+
+template<size_t ChunksN> class Check {
+public:
+    using stream = ledstream::chunked<encoding::wordsPerLed, chunkLedsN, ChunksN>;
+
+    // One frame on both channels, the second one with ledsN / 2 LEDs
+    size_t frame(Random::Stream &random, size_t ledsN) {
+        const size_t lengths[channelsN] = { ledsN, ledsN / 2 };
+        std::vector<color::rgba<uint16_t>> pixels[channelsN];
+        std::vector<size_t> encodes[channelsN];
+        for (size_t s = 0; s < channelsN; s++) {
+            for (size_t c = 0; c < lengths[s]; c++) {
+                pixels[s].emplace_back(uint16_t(random.get()), uint16_t(random.get()), uint16_t(random.get()));
+            }
+            encodes[s].assign(lengths[s], 0);
+            channels[s] = Channel();
+        }
+
+        // start()
+        for (size_t s = 0; s < channelsN; s++) {
+            send(s, streams[s].begin(lengths[s], Encoder { pixels[s], encodes[s] }));
+        }
+
+        // The PDMA moves one word per busy channel per step, completion runs the handler
+        for (bool busy = true; busy; ) {
+            busy = false;
+            uint32_t done = 0;
+            for (size_t s = 0; s < channelsN; s++) {
+                Channel &channel = channels[s];
+                if (!channel.busy) {
+                    continue;
+                }
+                busy = true;
+                channel.tx.push_back(channel.src[channel.pos++]);
+                if (channel.pos == channel.src.size()) {
+                    channel.busy = false;
+                    done |= 1UL << s;
+                }
+            }
+            // pdmaDone()
+            for (size_t s = 0; s < channelsN; s++) {
+                if ((done & (1UL << s)) == 0) {
+                    continue;
+                }
+                auto chunk = streams[s].next();
+                if (chunk.empty()) {
+                    continue;
+                }
+                send(s, chunk);
+                streams[s].refill(Encoder { pixels[s], encodes[s] });
+            }
+        }
+
+        size_t errors = 0;
+        for (size_t s = 0; s < channelsN; s++) {
+            std::vector<uint32_t> want(lengths[s] * encoding::wordsPerLed);
+            for (size_t c = 0; c < lengths[s]; c++) {
+                encoding::encode(&want[c * encoding::wordsPerLed], pixels[s][c]);
+            }
+            if (channels[s].tx != want) {
+                printf("%zu chunks, %zu LEDs, channel %zu: %zu words out, expected %zu\n",
+                    ChunksN, lengths[s], s, channels[s].tx.size(), want.size());
+                errors++;
+            }
+            for (size_t c = 0; c < lengths[s]; c++) {
+                if (encodes[s][c] != 1) {
+                    printf("%zu chunks, %zu LEDs, channel %zu: LED %zu encoded %zu times\n",
+                        ChunksN, lengths[s], s, c, encodes[s][c]);
+                    errors++;
+                    break;
+                }
+            }
+        }
+        return errors;
+    }
+
+private:
+    // Empty chunks are never started, the frame is complete
+    void send(size_t s, std::span<const uint32_t> chunk) {
+        channels[s].src = chunk;
+        channels[s].pos = 0;
+        channels[s].busy = !chunk.empty();
+    }
+
+    stream streams[channelsN];
+    Channel channels[channelsN];
+};
+
+int main(int argc, char *argv[]) {
+    size_t ledsMax = 1024;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-n") && c + 1 < argc) {
+            ledsMax = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: stream [-n leds]\n");
+            return 2;
+        }
+    }
+
+    // The point of streaming, RAM does not depend on the chain length
+    printf("%zu bytes of chunks per channel, %zu per LED encoded in one go\n",
+        sizeof(ledstream::chunked<encoding::wordsPerLed, chunkLedsN>), encoding::bytesPerLed);
+
+    Random::Stream random(0x57EA0000);
+    Check<2> two;
+    Check<3> three;
+    size_t errors = 0;
+    // The same streams carry on from frame to frame, like in the transport
+    for (size_t ledsN = 0; ledsN < ledsMax && errors < 8; ledsN++) {
+        errors += two.frame(random, ledsN);
+        errors += three.frame(random, ledsN);
+    }
+    printf("0 to %zu LEDs: %zu errors\n", ledsMax - 1, errors);
+    return errors ? 1 : 0;
+}
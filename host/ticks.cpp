@@ -0,0 +1,218 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Per frame cost of the scheduler time math, double seconds before and integer ticks after.
+//
+//   ticks [-n spans] [-f frames]
+//
+// Every frame reads the clock and, for each of the given number of effect spans, checks
+// whether it runs, walks the ADSR queries down to InReleasePeriod() and takes the two walker
+// phases. The before side is the double code Timeline had, including SystemTime() and its
+// divide of the timer count by the compare value. The after side uses Timeline::Now(),
+// Timeline::Effect and Timeline::Phase(). Prints the average time per frame for both.
+//
+// A host does doubles in hardware. On the Cortex-M4 every double operation of the before side
+// is a soft-float library call, so the difference there is larger than printed here.
+
+#include "../timeline.h"
+#include "../fastmath.h"
+#include "../profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+// What Timeline did before integer ticks
+namespace seconds {
+
+    // TIMER0 as it was set up, the compare value was read back at run time
+    static uint32_t systemSeconds = 0;
+    static volatile uint32_t timerCnt = 0;
+    static volatile uint32_t timerCmp = 10000;
+
+    static double SystemTime() {
+        return double(systemSeconds) + double(timerCnt) / double(timerCmp);
+    }
+
+    static constexpr double infinity = std::numeric_limits<double>::infinity();
+
+    struct Effect {
+        double time = 0.0;
+        double duration = 0.0;
+        double attack = 0.0;
+        double decay = 0.0;
+        double release = 0.0;
+
+        bool Active() const {
+            double now = SystemTime();
+            return time <= now && ( duration == infinity || ( time + duration ) > now );
+        }
+
+        std::tuple<bool, float> InAttackPeriod() const {
+            double now = SystemTime();
+            if ( (now - time) < attack) {
+                return {true, float((now - time) * (1.0 / attack)) };
+            }
+            return {false, 0.0f};
+        }
+
+        std::tuple<bool, float> InDecayPeriod() const {
+            double now = SystemTime();
+            if (!std::get<0>(InAttackPeriod())) {
+                if ( (now - time) < attack + decay) {
+                    return {true, float((now - time) * (1.0 / decay)) };
+                }
+            }
+            return {false, 0.0f};
+        }
+
+        std::tuple<bool, float> InSustainPeriod() const {
+            double now = SystemTime();
+            if (!std::get<0>(InDecayPeriod())) {
+                double sustain = duration - attack - decay - release;
+                if ( (now - time) < attack + decay + sustain) {
+                    return {true, float((now - time) * (1.0 / sustain)) };
+                }
+            }
+            return {false, 0.0f};
+        }
+
+        std::tuple<bool, float> InReleasePeriod() const {
+            double now = SystemTime();
+            if (!std::get<0>(InSustainPeriod())) {
+                double sustain = duration - attack - decay - release;
+                if ( (now - time) < attack + decay + sustain + release) {
+                    return { true, 1.0f - float(((time + duration) - now) * (1.0 / release)) };
+                }
+            }
+            return {false, 0.0f};
+        }
+    };
+
+    static float frame(const std::vector<Effect> &effects) {
+        static constexpr double speed = 1.0;
+        float sum = 0.0f;
+        for (const Effect &effect : effects) {
+            if (!effect.Active()) {
+                continue;
+            }
+            sum += std::get<1>(effect.InReleasePeriod());
+            double now = SystemTime();
+            sum += float(frac(now * (1.0 / 5.0) * speed));
+            sum += 1.0f - float(frac(now * speed));
+        }
+        return sum;
+    }
+
+}
+
+namespace ticks {
+
+    using Timeline = ::Timeline;
+
+    static bool Active(const Timeline::Effect &effect, Timeline::ticks now) {
+        return effect.time <= now && ( effect.duration == Timeline::forever || now - effect.time < effect.duration );
+    }
+
+    static float frame(const std::vector<Timeline::Effect> &effects) {
+        static constexpr double speed = 1.0;
+        float sum = 0.0f;
+        for (const Timeline::Effect &effect : effects) {
+            Timeline::ticks now = Timeline::Now();
+            if (!Active(effect, now)) {
+                continue;
+            }
+            sum += std::get<1>(effect.InReleasePeriod());
+            sum += Timeline::Phase(now, Timeline::Ticks(5.0 / speed));
+            sum += 1.0f - Timeline::Phase(now, Timeline::Ticks(1.0 / speed));
+        }
+        return sum;
+    }
+
+}
+
+// Keeps the optimizer from dropping the frames
+static volatile float sink;
+
+int main(int argc, char *argv[]) {
+    size_t spansN = 8;
+    size_t framesN = 120000;
+    for (int c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-n") && c + 1 < argc) {
+            spansN = size_t(atol(argv[++c]));
+        } else if (!strcmp(argv[c], "-f") && c + 1 < argc) {
+            framesN = size_t(atol(argv[++c]));
+        } else {
+            fprintf(stderr, "usage: ticks [-n spans] [-f frames]\n");
+            return 2;
+        }
+    }
+
+    Profiler::init();
+
+    // The same spans both ways, some forever and some with a full ADSR envelope
+    std::vector<seconds::Effect> before(spansN);
+    std::vector<Timeline::Effect> after(spansN);
+    for (size_t c = 0; c < spansN; c++) {
+        double start = double(c) * 0.5;
+        double duration = ( c % 2 ) ? seconds::infinity : 20.0 + double(c);
+        before[c].time = start;
+        before[c].duration = duration;
+        before[c].attack = 1.0;
+        before[c].decay = 2.0;
+        before[c].release = 3.0;
+        after[c].time = Timeline::Ticks(start);
+        after[c].duration = ( c % 2 ) ? Timeline::forever : Timeline::Ticks(duration);
+        after[c].attack = Timeline::Ticks(1.0);
+        after[c].decay = Timeline::Ticks(2.0);
+        after[c].release = Timeline::Ticks(3.0);
+    }
+
+    uint64_t beforeTime = 0;
+    uint64_t afterTime = 0;
+    float sum = 0.0f;
+    for (size_t f = 0; f < framesN; f++) {
+        Timeline::ticks now = Timeline::Ticks(double(f) / Timeline::effectRate);
+        seconds::systemSeconds = uint32_t(now / Timeline::ticksPerSecond);
+        seconds::timerCnt = uint32_t(now % Timeline::ticksPerSecond);
+        Timeline::SetHostTime(now);
+
+        uint32_t start = Profiler::now();
+        sum += seconds::frame(before);
+        beforeTime += Profiler::now() - start;
+
+        start = Profiler::now();
+        sum += ticks::frame(after);
+        afterTime += Profiler::now() - start;
+    }
+    sink = sum;
+
+    printf("%zu spans, %zu frames: double seconds %.1fns per frame, integer ticks %.1fns per frame\n",
+        spansN, framesN, double(beforeTime) * 1e9 / double(Profiler::frequency()) / double(framesN),
+        double(afterTime) * 1e9 / double(Profiler::frequency()) / double(framesN));
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Accuracy and speed of the fixed point sRGB output stage against the float reference.
+//
+//   transfer [-r rounds]
+//
+// Every 8-bit sRGB color, a step of 3 per channel, goes through lRGB2CIELUV and back through
+// both convert::CIELUV2sRGB16 and convert::CIELUV2sRGB, as do colors on an L/u/v grid well
+// outside the sRGB gamut which both have to clamp. Prints the worst and average difference in
+// 16-bit steps and fails if the worst is above maxError. Then times both paths over a frame of
+// LEDs for the given number of rounds and prints the time per LED.
+
+#include "../color.h"
+#include "../leds.h"
+#include "../profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+// In 16-bit steps, against the float path which is itself only as good as fast_pow
+static constexpr int32_t maxError = 16;
+
+struct Options {
+    size_t rounds = 20000;
+};
+
+static void usage() {
+    fprintf(stderr, "usage: transfer [-r rounds]\n");
+    exit(2);
+}
+
+static Options parse(int argc, char *argv[]) {
+    Options options;
+    for (int c = 1; c < argc; c++) {
+        auto arg = [&]() {
+            if (c + 1 >= argc) {
+                usage();
+            }
+            return argv[++c];
+        };
+        if (!strcmp(argv[c], "-r")) {
+            options.rounds = size_t(atol(arg()));
+        } else {
+            usage();
+        }
+    }
+    return options;
+}
+
+struct Stats {
+    int32_t worst = 0;
+    double sum = 0;
+    size_t count = 0;
+    vector::float4 worstLuv;
+
+    void add(const vector::float4 &luv, int32_t a, int32_t b) {
+        int32_t d = std::abs(a - b);
+        if (d > worst) {
+            worst = d;
+            worstLuv = luv;
+        }
+        sum += d;
+        count++;
+    }
+
+    bool report(const char *name) const {
+        printf("%-8s %8zu channels: worst %d avg %.2f", name, count, int(worst), sum / double(std::max(count, size_t(1))));
+        if (worst > 0) {
+            printf(" at L %.3f u %.3f v %.3f", double(worstLuv.x), double(worstLuv.y), double(worstLuv.z));
+        }
+        printf("\n");
+        return worst <= maxError;
+    }
+};
+
+static const color::convert converter;
+
+static void compare(const vector::float4 &luv, Stats &stats) {
+    color::rgba<uint16_t> fixed = converter.CIELUV2sRGB16(luv);
+    vector::float4 reference = converter.CIELUV2sRGB(luv);
+    auto to16 = [](float v) {
+        return int32_t(std::clamp(v * 65535.0f + 0.5f, 0.0f, 65535.0f));
+    };
+    stats.add(luv, fixed.r, to16(reference.x));
+    stats.add(luv, fixed.g, to16(reference.y));
+    stats.add(luv, fixed.b, to16(reference.z));
+}
+
+static bool accuracy() {
+    Stats inGamut;
+    for (int r = 0; r < 256; r += 3) {
+        for (int g = 0; g < 256; g += 3) {
+            for (int b = 0; b < 256; b += 3) {
+                compare(color::srgb8(color::rgba<uint8_t>(uint8_t(r), uint8_t(g), uint8_t(b))), inGamut);
+            }
+        }
+    }
+
+    Stats outOfGamut;
+    for (int l = 0; l <= 100; l++) {
+        for (int u = -90; u <= 90; u += 2) {
+            for (int v = -90; v <= 90; v += 2) {
+                compare(vector::float4(float(l) * 0.01f, float(u) * 0.02f, float(v) * 0.02f), outOfGamut);
+            }
+        }
+    }
+
+    bool ok = inGamut.report("sRGB");
+    ok &= outOfGamut.report("L/u/v");
+    return ok;
+}
+
+// Keeps the optimizer from dropping the conversions
+static volatile uint32_t sink;
+
+template<class F> static double perLed(const Options &options, const std::vector<vector::float4> &leds, F &&convert) {
+    uint32_t best = ~uint32_t(0);
+    for (size_t r = 0; r < options.rounds; r++) {
+        uint32_t start = Profiler::now();
+        uint32_t acc = 0;
+        for (const vector::float4 &luv : leds) {
+            acc += convert(luv);
+        }
+        best = std::min(best, Profiler::now() - start);
+        sink = acc;
+    }
+    return double(Profiler::toMicroseconds(best)) * 1000.0 / double(leds.size());
+}
+
+static void benchmark(const Options &options) {
+    std::vector<vector::float4> leds;
+    for (size_t c = 0; c < Leds::ledsN; c++) {
+        float h = float(c) / float(Leds::ledsN);
+        leds.push_back(color::hsv(vector::float4(h, 0.8f, 0.2f + 0.8f * h)));
+    }
+
+    double fixed = perLed(options, leds, [](const vector::float4 &luv) {
+        color::rgba<uint16_t> rgb = converter.CIELUV2sRGB16(luv);
+        return uint32_t(rgb.r + rgb.g + rgb.b);
+    });
+    double reference = perLed(options, leds, [](const vector::float4 &luv) {
+        color::rgba<uint16_t> rgb(converter.CIELUV2sRGB(luv));
+        return uint32_t(rgb.r + rgb.g + rgb.b);
+    });
+    printf("%zu LEDs, best of %zu rounds: fixed %.1fns/LED, float %.1fns/LED\n",
+        leds.size(), options.rounds, fixed, reference);
+}
+
+int main(int argc, char *argv[]) {
+    Options options = parse(argc, argv);
+
+    Profiler::init();
+
+    bool ok = accuracy();
+    benchmark(options);
+
+    return ok ? 0 : 1;
+}
@@ -24,6 +24,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./stm32wl.h"
 #include "./sdd1306.h"
 #include "./timeline.h"
+#include "./leds.h"
 
 #include "M480.h"
 
@@ -35,6 +36,7 @@ extern "C" {
     }
     void PDMA_IRQHandler(void) {
         I2CManager::instance().PDMA_IRQHandler();
+        Leds::instance().PDMA_IRQHandler();
     }
 }
 
@@ -129,19 +131,12 @@ void I2CManager::I2C0_IRQHandler(void) {
 }
 
 void I2CManager::PDMA_IRQHandler(void) {
+    // Other channels belong to the LED transports
     uint32_t u32Status = PDMA->TDSTS;
     if(u32Status & (0x1 << I2C0_PDMA_TX_CH)) {
         PDMA->TDSTS = 0x1 << I2C0_PDMA_TX_CH;
         pdmaDone = true;
     }
-    if(u32Status & (0x1 << 2)) {
-        PDMA->TDSTS = 0x1 << 2;
-        printf("2!!!\n");
-    }
-    if(u32Status & (0x1 << 3)) {
-        PDMA->TDSTS = 0x1 << 3;
-        printf("2!!!\n");
-    }
 }
 
 void I2CManager::performBatchWrite() {
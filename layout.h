@@ -0,0 +1,124 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include "./vector.h"
+
+#include <array>
+#include <tuple>
+#include <numbers>
+#include <cmath>
+
+// Compile time description of the physical LED setup. A topology is a list of segments,
+// each one a shape (LED count and positions) wired to an output with a wire protocol.
+// LED counts, offsets into the flat framebuffer and the position map are all derived from it.
+//
+// Leds and its transports still expect the pendant shape, sidesN sides each with a ring on an
+// SPI output and a bird on a GPIO, and leds.cpp static_asserts that. Shapes, counts, protocols
+// and the order of segments can change here, a different set of outputs needs new transports.
+namespace layout {
+
+    enum class protocol {
+        ws2812,
+        ws2816,
+        sk6812
+    };
+
+    enum class output {
+        spi0,
+        spi1,
+        gpio_pb2,
+        gpio_pb13
+    };
+
+    template<size_t N> struct ring {
+        static constexpr size_t ledsN = N;
+
+        static consteval vector::float4 position(size_t index) {
+            float a = - float(std::numbers::pi) * 0.5f + 2.0f * float(std::numbers::pi) * float(index) / float(N);
+            return vector::float4(cosf(a), -sinf(a), float(index) / float(N), a);
+        }
+    };
+
+    struct bird {
+        static constexpr size_t ledsN = 8;
+
+        static consteval vector::float4 position(size_t index) {
+            constexpr float xy[ledsN][2] = {
+                {   0.0f,  12.0f },
+                { -11.0f,   5.0f },
+                {  -7.0f,   0.0f },
+                {   0.0f,   0.0f },
+                {   7.0f,   0.0f },
+                {  11.0f,   5.0f },
+                {   0.0f,  -8.0f },
+                {   0.0f, -16.0f }
+            };
+            vector::float4 p = vector::float4(xy[index][0], xy[index][1], 0.0f, 0.0f) * (1.0f / 25.0f);
+            p.w = sqrtf(p.x * p.x + p.y * p.y);
+            return p;
+        }
+    };
+
+    template<class Shape, output Output, protocol Protocol = protocol::ws2816> struct segment {
+        using shape = Shape;
+        static constexpr size_t ledsN = Shape::ledsN;
+        static constexpr layout::output output = Output;
+        static constexpr layout::protocol protocol = Protocol;
+    };
+
+    template<class... Segments> struct topology {
+        static constexpr size_t segmentsN = sizeof...(Segments);
+        static constexpr size_t ledsN = ( Segments::ledsN + ... );
+
+        template<size_t S> using segment = std::tuple_element_t<S, std::tuple<Segments...>>;
+
+        static constexpr std::array<size_t, segmentsN> counts { Segments::ledsN... };
+        static constexpr std::array<output, segmentsN> outputs { Segments::output... };
+
+        static constexpr std::array<size_t, segmentsN> offsets = [] {
+            std::array<size_t, segmentsN> o {};
+            for (size_t c = 1; c < segmentsN; c++) {
+                o[c] = o[c - 1] + counts[c - 1];
+            }
+            return o;
+        }();
+
+        static constexpr size_t index(size_t segment, size_t led) {
+            return offsets[segment] + led;
+        }
+    };
+
+    // The pendant: two sides, each with a 32 LED ring on SPI and an 8 LED bird on a GPIO.
+    // Segment order matches the framebuffer order Leds::get()/set() always used.
+    using pendant = topology<
+        segment<ring<32>, output::spi0>,
+        segment<ring<32>, output::spi1>,
+        segment<bird, output::gpio_pb2>,
+        segment<bird, output::gpio_pb13>
+    >;
+
+}
+
+#endif /* LAYOUT_H_ */
@@ -24,22 +24,30 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "./main.h"
 #include "./leds.h"
+#include "./ledsprepare.h"
 #include "./color.h"
 #include "./model.h"
+#include "./ledstream.h"
+#include "./onewire.h"
+#include "./profiler.h"
 
 #include <memory.h>
 
 #define SPI0_MASTER_TX_DMA_CH   0
 #define SPI1_MASTER_TX_DMA_CH   1
-#define EPWM1_TX_DMA_CH         2
-#define EPWM0_TX_DMA_CH         3
+// Channel 4 is I2C0, see I2CManager
+#define GPIO_TX_DMA_CH          5
 
 extern "C" 
 {
 
-#ifndef USE_PWM_DMA
+#ifdef USE_PWM
+void EPWM0P1_IRQHandler(void);
+void EPWM1P1_IRQHandler(void);
+
 static uint8_t *pwm0Buf = 0;
 static uint8_t *pwm0BufEnd = 0;
+static volatile bool pwmTransferActive = false;
 
 __attribute__ ((optimize("Os"), flatten))
 void EPWM0P1_IRQHandler(void) {
@@ -82,276 +90,529 @@ void EPWM1P1_IRQHandler(void) {
         *cnten &= ~EPWM_CH_2_MASK;
         // Pull line down by setting back to GPIO
         *gpb_mfpl = (*gpb_mfpl & ~(SYS_GPB_MFPH_PB13MFP_Msk)) | (SYS_GPB_MFPH_PB13MFP_GPIO);
+        // Both sides are out
+        pwmTransferActive = false;
     }
 }
-#endif  // #ifndef USE_DMA
+#endif  // #ifdef USE_PWM
 
 }
 
-Leds &Leds::instance() {
-    static Leds leds;
-    if (!leds.initialized) {
-        leds.initialized = true;
-        leds.init();
+// Transports below are written for this wiring
+static_assert(Leds::topology::segmentsN == Leds::sidesN * 2);
+static_assert(Leds::topology::outputs[Leds::circleSegment(0)] == layout::output::spi0);
+static_assert(Leds::topology::outputs[Leds::circleSegment(1)] == layout::output::spi1);
+static_assert(Leds::topology::outputs[Leds::birdSegment(0)] == layout::output::gpio_pb2);
+static_assert(Leds::topology::outputs[Leds::birdSegment(1)] == layout::output::gpio_pb13);
+static_assert(Leds::topology::counts[Leds::circleSegment(0)] == Leds::topology::counts[Leds::circleSegment(1)]);
+static_assert(Leds::topology::counts[Leds::birdSegment(0)] == Leds::topology::counts[Leds::birdSegment(1)]);
+
+// Encoder for the wire protocol a segment is declared with
+template<size_t Segment, class Wire> using SegmentEncoder =
+    onewire::encoder<typename onewire::protocol_of<Leds::topology::segment<Segment>::protocol>::type, Wire>;
+
+// LED transports. Each one owns ping-pong encode buffers and provides:
+//
+//  init()                      one time peripheral setup
+//  encode(side, index, pixel)  encode one LED into the back buffer at its fixed offset
+//  encodeMirrored(index, mirrorIndex, pixel)
+//                              encode one LED for side 0 and reuse it for side 1 at mirrorIndex
+//  copy(side, index)           copy the encoding of one LED from the buffer sent last into the back buffer
+//  copyMirrored(index, mirrorIndex)
+//                              same for a LED encoded with encodeMirrored()
+//  start()                     wait for the previous frame, flip buffers and send the new front buffer
+//  wait()                      block until the front buffer is out
+//  stop()                      abort whatever is in flight
+//
+// Rings go out through SPIRingTransport or SPIStreamRingTransport, birds through the transport
+// selected in leds.h.
+
+class SPIRingTransport {
+public:
+    void init() {
+        SPI_Open(SPI0, SPI_MASTER, SPI_MODE_0, 32, 4000000);
+        SPI_Open(SPI1, SPI_MASTER, SPI_MODE_0, 32, 4000000);
+
+#ifdef USE_SPI_DMA
+        PDMA_Open(PDMA,(1UL << SPI0_MASTER_TX_DMA_CH)|(1UL << SPI1_MASTER_TX_DMA_CH));
+
+        PDMA_SetTransferCnt(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_WIDTH_32, buffers[0][0].size());
+        PDMA_SetTransferAddr(PDMA, SPI0_MASTER_TX_DMA_CH, (uint32_t)buffers[0][0].data(), PDMA_SAR_INC, (uint32_t)&SPI0->TX, PDMA_DAR_FIX);
+        PDMA_SetTransferMode(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_SPI0_TX, FALSE, 0);
+        PDMA_SetBurstType(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
+        PDMA->DSCT[SPI0_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+
+        PDMA_SetTransferCnt(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_32, buffers[0][1].size());
+        PDMA_SetTransferAddr(PDMA, SPI1_MASTER_TX_DMA_CH, (uint32_t)buffers[0][1].data(), PDMA_SAR_INC, (uint32_t)&SPI1->TX, PDMA_DAR_FIX);
+        PDMA_SetTransferMode(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
+        PDMA_SetBurstType(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
+        PDMA->DSCT[SPI1_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+#endif  // #ifdef USE_SPI_DMA
     }
-    return leds;
-}
 
-struct Leds::Map Leds::map;
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encoding::encode(&buffers[back][side][index * encoding::wordsPerLed], pixel);
+    }
 
-const Leds::lut_table Leds::lut;
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        encode(0, index, pixel);
+        memcpy(&buffers[back][1][mirrorIndex * encoding::wordsPerLed], &buffers[back][0][index * encoding::wordsPerLed], encoding::bytesPerLed);
+    }
 
-void Leds::init() {
+    void copy(size_t side, size_t index) {
+        size_t last = ( back + Leds::bufferN - 1 ) % Leds::bufferN;
+        memcpy(&buffers[back][side][index * encoding::wordsPerLed], &buffers[last][side][index * encoding::wordsPerLed], encoding::bytesPerLed);
+    }
 
-    // LED_ON
-    GPIO_SetMode(PF, BIT3, GPIO_MODE_OUTPUT);
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        copy(0, index);
+        copy(1, mirrorIndex);
+    }
 
-    half();
+    void start() {
+        wait();
 
-    // Turn Mosfet on
-    PF3 = 0;
+        auto &front = buffers[back];
+        back = ( back + 1 ) % Leds::bufferN;
 
-    SPI_Open(SPI0, SPI_MASTER, SPI_MODE_0, 8, 4000000);
-    SPI_Open(SPI1, SPI_MASTER, SPI_MODE_0, 8, 4000000);
+#ifdef USE_SPI_DMA
+        PDMA_CLR_TD_FLAG(PDMA, dmaMask);
+        active = true;
+
+        PDMA_SET_SRC_ADDR(PDMA,SPI0_MASTER_TX_DMA_CH, (uint32_t)front[0].data());
+        PDMA_SetTransferCnt(PDMA,SPI0_MASTER_TX_DMA_CH, PDMA_WIDTH_32, front[0].size());
+        PDMA_SetTransferMode(PDMA,SPI0_MASTER_TX_DMA_CH, PDMA_SPI0_TX, FALSE, 0);
+        SPI_TRIGGER_TX_PDMA(SPI0);
+
+        PDMA_SET_SRC_ADDR(PDMA,SPI1_MASTER_TX_DMA_CH, (uint32_t)front[1].data());
+        PDMA_SetTransferCnt(PDMA,SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_32, front[1].size());
+        PDMA_SetTransferMode(PDMA,SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
+        SPI_TRIGGER_TX_PDMA(SPI1);
+#else  // #ifdef USE_SPI_DMA
+        for(size_t c = 0; c < front[0].size(); c++) {
+            while(SPI_GET_TX_FIFO_FULL_FLAG(SPI0) == 1) {}
+            SPI_WRITE_TX(SPI0, front[0][c]);
+        }
+
+        for(size_t c = 0; c < front[1].size(); c++) {
+            while(SPI_GET_TX_FIFO_FULL_FLAG(SPI1) == 1) {}
+            SPI_WRITE_TX(SPI1, front[1][c]);
+        }
+#endif  // #ifdef USE_SPI_DMA
+    }
 
-    GPIO_SetMode(PB, BIT2, GPIO_MODE_OUTPUT);
-    PB2 = 0;
+    void wait() {
+#ifdef USE_SPI_DMA
+        if (active) {
+            while ((PDMA_GET_TD_STS(PDMA) & dmaMask) != dmaMask) {}
+            PDMA_CLR_TD_FLAG(PDMA, dmaMask);
+            // Last word may still be in the shift register
+            while (SPI_IS_BUSY(SPI0) || SPI_IS_BUSY(SPI1)) {}
+            active = false;
+        }
+#endif  // #ifdef USE_SPI_DMA
+    }
 
-    GPIO_SetMode(PB, BIT13, GPIO_MODE_OUTPUT);
-    PB13 = 0;
+    void stop() {
+        wait();
+    }
 
-#ifdef USE_PWM
+private:
+    // SPI shifts 32-bit frames MSB first
+    using encoding = SegmentEncoder<Leds::circleSegment(0), onewire::spi_nibble<32>>;
 
-    // TOP_LED_BIRD
-    CLK_SetModuleClock(EPWM0_MODULE, CLK_CLKSEL2_EPWM0SEL_PLL, 0); // 96Mhz
-    CLK_EnableModuleClock(EPWM0_MODULE);
+    static constexpr uint32_t dmaMask = (1UL << SPI0_MASTER_TX_DMA_CH)|(1UL << SPI1_MASTER_TX_DMA_CH);
 
-    // BOTTOM_LED_BIRD
-    CLK_SetModuleClock(EPWM1_MODULE, CLK_CLKSEL2_EPWM1SEL_PLL, 0); // 96Mhz
-    CLK_EnableModuleClock(EPWM1_MODULE);
+    std::array<std::array<std::array<uint32_t, Leds::circleLedsN * encoding::wordsPerLed>, Leds::sidesN>, Leds::bufferN> buffers __attribute__ ((aligned (16)));
+    size_t back = 0;
+    bool active = false;
+};
 
-#endif // #ifdef USE_PWM
+#ifdef USE_SPI_STREAM
 
-#ifdef USE_SPI_DMA
+// Same wire format as SPIRingTransport, but only the 48-bit pixels are kept per LED. They are
+// encoded into small chunks on the fly from the PDMA completion interrupt while the previous
+// chunk shifts out, so the encode buffers stay the same size no matter how long the chain is.
+class SPIStreamRingTransport {
+public:
+    void init() {
+        SPI_Open(SPI0, SPI_MASTER, SPI_MODE_0, 32, 4000000);
+        SPI_Open(SPI1, SPI_MASTER, SPI_MODE_0, 32, 4000000);
 
-    PDMA_Open(PDMA,(1UL << SPI0_MASTER_TX_DMA_CH)|(1UL << SPI1_MASTER_TX_DMA_CH));
+        PDMA_Open(PDMA, dmaMask);
 
-    PDMA_SetTransferCnt(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_WIDTH_8, circleLedsDMABuf[0].size());
-    PDMA_SetTransferAddr(PDMA, SPI0_MASTER_TX_DMA_CH, (uint32_t)circleLedsDMABuf[0].data(), PDMA_SAR_INC, (uint32_t)&SPI0->TX, PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_SPI0_TX, FALSE, 0);
-    PDMA_SetBurstType(PDMA, SPI0_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[SPI0_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            PDMA_SetTransferAddr(PDMA, dmaChannel[s], 0, PDMA_SAR_INC, spiTx[s], PDMA_DAR_FIX);
+            PDMA_SetBurstType(PDMA, dmaChannel[s], PDMA_REQ_SINGLE, 0);
+            PDMA_EnableInt(PDMA, dmaChannel[s], PDMA_INT_TRANS_DONE);
+        }
 
-    PDMA_SetTransferCnt(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_8, circleLedsDMABuf[1].size());
-    PDMA_SetTransferAddr(PDMA, SPI1_MASTER_TX_DMA_CH, (uint32_t)circleLedsDMABuf[1].data(), PDMA_SAR_INC, (uint32_t)&SPI1->TX, PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
-    PDMA_SetBurstType(PDMA, SPI1_MASTER_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[SPI1_MASTER_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+        NVIC_EnableIRQ(PDMA_IRQn);
+    }
 
-#endif  // #ifdef USE_SPI_DMA
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        pixels[back][side][index] = { pixel.g, pixel.r, pixel.b };
+    }
 
-#ifdef USE_PWM_DMA
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        encode(0, index, pixel);
+        pixels[back][1][mirrorIndex] = pixels[back][0][index];
+    }
 
-    PDMA_Open(PDMA,(1UL << EPWM0_TX_DMA_CH)|(1UL << EPWM1_TX_DMA_CH));
+    void copy(size_t side, size_t index) {
+        pixels[back][side][index] = pixels[sending][side][index];
+    }
 
-    PDMA_SetTransferCnt(PDMA, EPWM0_TX_DMA_CH, PDMA_WIDTH_8, birdsLedsDMABuf[0].size());
-    PDMA_SetTransferAddr(PDMA, EPWM0_TX_DMA_CH, (uint32_t)birdsLedsDMABuf[0].data(), PDMA_SAR_INC, (uint32_t)&EPWM0->CMPDAT[3], PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, EPWM0_TX_DMA_CH, PDMA_EPWM0_CH3_TX, FALSE, 0);
-    PDMA_SetBurstType(PDMA, EPWM0_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[EPWM0_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        copy(0, index);
+        copy(1, mirrorIndex);
+    }
 
-    PDMA_SetTransferCnt(PDMA, EPWM1_TX_DMA_CH, PDMA_WIDTH_8, birdsLedsDMABuf[1].size());
-    PDMA_SetTransferAddr(PDMA, EPWM1_TX_DMA_CH, (uint32_t)birdsLedsDMABuf[1].data(), PDMA_SAR_INC, (uint32_t)&EPWM1->CMPDAT[2], PDMA_DAR_FIX);
-    PDMA_SetTransferMode(PDMA, EPWM1_TX_DMA_CH, PDMA_EPWM1_CH2_TX, FALSE, 0);
-    PDMA_SetBurstType(PDMA, EPWM1_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
-    PDMA->DSCT[EPWM1_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+    void start() {
+        wait();
 
-#endif // #ifdef USE_PWM_DMA
+        sending = back;
+        back = ( back + 1 ) % Leds::bufferN;
 
-}
+        active = dmaMask;
 
-void Leds::prepare() {
-    static color::convert converter;
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            send(s, streams[s].begin(Leds::circleLedsN, encoder { pixels[sending][s] }));
+        }
 
-    float brightness = Model::instance().Brightness();
+        SPI_TRIGGER_TX_PDMA(SPI0);
+        SPI_TRIGGER_TX_PDMA(SPI1);
+    }
 
-    uint32_t *ptr0 = reinterpret_cast<uint32_t *>(circleLedsDMABuf[0].data());
-    uint32_t *ptr1 = reinterpret_cast<uint32_t *>(circleLedsDMABuf[1].data());
-    for (size_t c = 0; c < circleLedsN; c++) {
-        color::rgba<uint16_t> pixel0(color::rgba<uint16_t>(converter.CIELUV2sRGB(circleLeds[0][c]*brightness)).fix_for_ws2816());
-        color::rgba<uint16_t> pixel1(color::rgba<uint16_t>(converter.CIELUV2sRGB(circleLeds[1][c]*brightness)).fix_for_ws2816());
+    void wait() {
+        while (active) {}
+        // Last word may still be in the shift register
+        while (SPI_IS_BUSY(SPI0) || SPI_IS_BUSY(SPI1)) {}
+    }
 
-        auto convert_to_one_wire_spi = [] (uint32_t *p, uint16_t v) {
-            *p++ = lut[(v>>8)&0xFF];
-            *p++ = lut[(v>>0)&0xFF];
-            return p;
-        };
+    void stop() {
+        wait();
+    }
 
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.g);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.r);
-        ptr0 = convert_to_one_wire_spi(ptr0, pixel0.b);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.g);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.r);
-        ptr1 = convert_to_one_wire_spi(ptr1, pixel1.b);
+    // Called from PDMA_IRQHandler
+    void pdmaDone() {
+        uint32_t status = PDMA->TDSTS & dmaMask;
+        PDMA->TDSTS = status;
+        for (size_t s = 0; s < Leds::sidesN; s++) {
+            if ((status & (1UL << dmaChannel[s])) == 0) {
+                continue;
+            }
+            auto chunk = streams[s].next();
+            if (chunk.empty()) {
+                active &= ~(1UL << dmaChannel[s]);
+                continue;
+            }
+            send(s, chunk);
+            streams[s].refill(encoder { pixels[sending][s] });
+        }
+    }
 
+private:
+    using encoding = SegmentEncoder<Leds::circleSegment(0), onewire::spi_nibble<32>>;
+
+    static constexpr size_t chunkLedsN = 16;
+    static constexpr uint32_t dmaChannel[Leds::sidesN] = { SPI0_MASTER_TX_DMA_CH, SPI1_MASTER_TX_DMA_CH };
+    static constexpr uint32_t dmaRequest[Leds::sidesN] = { PDMA_SPI0_TX, PDMA_SPI1_TX };
+    static constexpr uint32_t dmaMask = (1UL << SPI0_MASTER_TX_DMA_CH)|(1UL << SPI1_MASTER_TX_DMA_CH);
+    static inline const uint32_t spiTx[Leds::sidesN] = { (uint32_t)&SPI0->TX, (uint32_t)&SPI1->TX };
+
+    struct pixel48 {
+        uint16_t g;
+        uint16_t r;
+        uint16_t b;
+    };
+
+    struct encoder {
+        const std::array<pixel48, Leds::circleLedsN> &pixels;
+
+        void operator()(uint32_t *p, size_t index) const {
+            const pixel48 &pixel = pixels[index];
+            encoding::encode(p, color::rgba<uint16_t>(pixel.r, pixel.g, pixel.b));
+        }
+    };
+
+    void send(size_t side, std::span<const uint32_t> chunk) {
+        PDMA_SET_SRC_ADDR(PDMA, dmaChannel[side], (uint32_t)chunk.data());
+        PDMA_SetTransferCnt(PDMA, dmaChannel[side], PDMA_WIDTH_32, chunk.size());
+        PDMA_SetTransferMode(PDMA, dmaChannel[side], dmaRequest[side], FALSE, 0);
     }
 
-#ifdef USE_PWM
-    uint8_t *ptr2 = birdsLedsDMABuf[0].data();
-    uint8_t *ptr3 = birdsLedsDMABuf[1].data();
-#else  // #ifdef USE_PWM
-    uint32_t *ptr2 = reinterpret_cast<uint32_t *>(birdsLedsDMABuf[0].data());
-    uint32_t *ptr3 = reinterpret_cast<uint32_t *>(birdsLedsDMABuf[1].data());
-#endif  // #ifdef USE_PWM
-    for (size_t c = 0; c < birdLedsN; c++) {
-        color::rgba<uint16_t> pixel0(color::rgba<uint16_t>(converter.CIELUV2sRGB(birdLeds[0][c]*brightness)).fix_for_ws2816());
-        color::rgba<uint16_t> pixel1(color::rgba<uint16_t>(converter.CIELUV2sRGB(birdLeds[1][c]*brightness)).fix_for_ws2816());
+    std::array<std::array<std::array<pixel48, Leds::circleLedsN>, Leds::sidesN>, Leds::bufferN> pixels;
+    std::array<ledstream::chunked<encoding::wordsPerLed, chunkLedsN>, Leds::sidesN> streams;
+    size_t back = 0;
+    size_t sending = 0;
+    volatile uint32_t active = 0;
+};
 
-#ifdef USE_PWM
-        auto convert_to_one_wire_pwm = [] (uint8_t *p, uint16_t v) {
-            for (uint32_t b = 0; b < 16; b++) {
-                if ( ((1<<(15-b)) & v) != 0 ) {
-                    *p++ = 0x40;
-                } else {
-                    *p++ = 0x20;
-                }
-            }
-            return p;
-        };
-
-        ptr2 = convert_to_one_wire_pwm(ptr2, pixel0.g);
-        ptr2 = convert_to_one_wire_pwm(ptr2, pixel0.r);
-        ptr2 = convert_to_one_wire_pwm(ptr2, pixel0.b);
-        ptr3 = convert_to_one_wire_pwm(ptr3, pixel1.g);
-        ptr3 = convert_to_one_wire_pwm(ptr3, pixel1.r);
-        ptr3 = convert_to_one_wire_pwm(ptr3, pixel1.b);
-#else  // #ifdef USE_PWM
-        auto convert_to_one_wire_spi = [] (uint32_t *p, uint16_t v) {
-            *p++ = lut[(v>>8)&0xFF];
-            *p++ = lut[(v>>0)&0xFF];
-            return p;
-        };
-
-        ptr2 = convert_to_one_wire_spi(ptr2, pixel0.g);
-        ptr2 = convert_to_one_wire_spi(ptr2, pixel0.r);
-        ptr2 = convert_to_one_wire_spi(ptr2, pixel0.b);
-        ptr3 = convert_to_one_wire_spi(ptr3, pixel1.g);
-        ptr3 = convert_to_one_wire_spi(ptr3, pixel1.r);
-        ptr3 = convert_to_one_wire_spi(ptr3, pixel1.b);
-#endif  // #ifdef USE_PWM
+using RingTransport = SPIStreamRingTransport;
+
+#else  // #ifdef USE_SPI_STREAM
+
+using RingTransport = SPIRingTransport;
+
+#endif  // #ifdef USE_SPI_STREAM
+
+#if defined(USE_GPIO_DMA)
+
+// Both bird chains sit on port B, so a single PDMA channel paced by TIMER2 writes PB->DOUT
+// and clocks out top and bottom in parallel, see onewire::gpio_slots for the waveform.
+class GPIODMABirdTransport {
+public:
+    void init() {
+        // Only PB2 and PB13 can be changed through PB->DOUT
+        PB->DATMSK = ~(pinMask[0] | pinMask[1]) & 0xFFFF;
+
+        for (auto &buffer : buffers) {
+            buffer.fill(0);
+            slots::prepare(buffer.data(), pinMask[0] | pinMask[1], Leds::birdLedsN * Leds::bitsPerLed);
+        }
+
+        CLK_EnableModuleClock(TMR2_MODULE);
+        CLK_SetModuleClock(TMR2_MODULE, CLK_CLKSEL1_TMR2SEL_PCLK1, MODULE_NoMsk); // 96Mhz
+        TIMER_Open(TIMER2, TIMER_PERIODIC_MODE, slots::slotRate);
+        TIMER_SetTriggerTarget(TIMER2, TIMER_TRG_TO_PDMA);
+
+        PDMA_Open(PDMA, 1UL << GPIO_TX_DMA_CH);
+
+        PDMA_SetTransferCnt(PDMA, GPIO_TX_DMA_CH, PDMA_WIDTH_32, buffers[0].size());
+        PDMA_SetTransferAddr(PDMA, GPIO_TX_DMA_CH, (uint32_t)buffers[0].data(), PDMA_SAR_INC, (uint32_t)&PB->DOUT, PDMA_DAR_FIX);
+        PDMA_SetTransferMode(PDMA, GPIO_TX_DMA_CH, PDMA_TMR2, FALSE, 0);
+        PDMA_SetBurstType(PDMA, GPIO_TX_DMA_CH, PDMA_REQ_SINGLE, 0);
+        PDMA->DSCT[GPIO_TX_DMA_CH].CTL |= PDMA_DSCT_CTL_TBINTDIS_Msk;
+        PDMA_EnableInt(PDMA, GPIO_TX_DMA_CH, PDMA_INT_TRANS_DONE);
+
+        NVIC_EnableIRQ(PDMA_IRQn);
     }
 
-#ifdef USE_PWM
-    for (size_t c = 0; c < extraBirdPadding; c++) {
-        *ptr2++ = 0;
-        *ptr3++ = 0;
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encodePins(pinMask[side], index, pixel);
     }
-#endif  // #ifdef USE_PWM
-}
 
-void Leds::forceStop() {
-    EPWM_ForceStop(EPWM0, EPWM_CH_3_MASK);
-    EPWM_ForceStop(EPWM1, EPWM_CH_2_MASK);
-}
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        // Both sides share the slot words, so matching positions are written in a single pass
+        if (index == mirrorIndex) {
+            encodePins(pinMask[0] | pinMask[1], index, pixel);
+        } else {
+            encodePins(pinMask[0], index, pixel);
+            encodePins(pinMask[1], mirrorIndex, pixel);
+        }
+    }
 
-__attribute__ ((hot, optimize("Os"), flatten))
-void Leds::transfer() {
-    prepare();
+    void copy(size_t side, size_t index) {
+        copyPins(pinMask[side], index);
+    }
 
-#ifdef USE_SPI_DMA
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        if (index == mirrorIndex) {
+            copyPins(pinMask[0] | pinMask[1], index);
+        } else {
+            copyPins(pinMask[0], index);
+            copyPins(pinMask[1], mirrorIndex);
+        }
+    }
 
-    PDMA_SetTransferCnt(PDMA,SPI0_MASTER_TX_DMA_CH, PDMA_WIDTH_8, circleLedsDMABuf[0].size());
-    PDMA_SetTransferMode(PDMA,SPI0_MASTER_TX_DMA_CH, PDMA_SPI0_TX, FALSE, 0);
-    SPI_TRIGGER_TX_PDMA(SPI0);
+    void start() {
+        wait();
 
-    PDMA_SetTransferCnt(PDMA,SPI1_MASTER_TX_DMA_CH, PDMA_WIDTH_8, circleLedsDMABuf[1].size());
-    PDMA_SetTransferMode(PDMA,SPI1_MASTER_TX_DMA_CH, PDMA_SPI1_TX, FALSE, 0);
-    SPI_TRIGGER_TX_PDMA(SPI1);
+        auto &front = buffers[back];
+        back = ( back + 1 ) % Leds::bufferN;
 
-#else  // #ifdef USE_DMA
+        active = true;
 
-    for(size_t c = 0; c < circleLedsDMABuf[0].size(); c++) {
-        while(SPI_GET_TX_FIFO_FULL_FLAG(SPI0) == 1) {}
-        SPI_WRITE_TX(SPI0, circleLedsDMABuf[0].data()[c]);
+        PDMA_SET_SRC_ADDR(PDMA, GPIO_TX_DMA_CH, (uint32_t)front.data());
+        PDMA_SetTransferCnt(PDMA, GPIO_TX_DMA_CH, PDMA_WIDTH_32, front.size());
+        PDMA_SetTransferMode(PDMA, GPIO_TX_DMA_CH, PDMA_TMR2, FALSE, 0);
+
+        TIMER_ResetCounter(TIMER2);
+        TIMER_Start(TIMER2);
     }
 
-    for(size_t c = 0; c < circleLedsDMABuf[1].size(); c++) {
-        while(SPI_GET_TX_FIFO_FULL_FLAG(SPI1) == 1) {}
-        SPI_WRITE_TX(SPI1, circleLedsDMABuf[1].data()[c]);
+    void wait() {
+        while (active) {}
+        TIMER_Stop(TIMER2);
     }
 
-#endif  // #ifdef USE_DMA
+    void stop() {
+        wait();
+    }
 
-#ifdef USE_PWM
-    // TOP_LED_BIRD
-    PB2 = 0;
+    // Called from PDMA_IRQHandler, only ever looks at our own channel
+    void pdmaDone() {
+        if (PDMA->TDSTS & (1UL << GPIO_TX_DMA_CH)) {
+            // Once per frame, unlike the EPWM bit interrupts of PWMBirdTransport which stay unprofiled
+            Profiler::Scope profile(Profiler::BirdIRQ);
+            PDMA->TDSTS = 1UL << GPIO_TX_DMA_CH;
+            active = false;
+        }
+    }
 
-    SYS->GPB_MFPL &= ~(SYS_GPB_MFPL_PB2MFP_Msk);
-    SYS->GPB_MFPL |= (SYS_GPB_MFPL_PB2MFP_EPWM0_CH3);
+private:
+    using slots = onewire::gpio_slots;
+    using protocol = onewire::protocol_of<Leds::topology::segment<Leds::birdSegment(0)>::protocol>::type;
+    static_assert(protocol::bitsPerComponent == Leds::bitsPerComponent);
 
-    EPWM_ConfigOutputChannel(EPWM0, 3, 800000, 0);
-    EPWM_SET_PRESCALER(EPWM0, 3, 0);
-    EPWM_EnableOutput(EPWM0, EPWM_CH_3_MASK);
+    static constexpr size_t extraPadding = 8; // Leave the lines low at the end
+    static constexpr uint32_t pinMask[Leds::sidesN] = { BIT2, BIT13 };
 
-#ifndef USE_PWM_DMA
-    EPWM_EnableZeroInt(EPWM0, 3);
-    NVIC_SetPriority(EPWM0P1_IRQn, 0);
-    NVIC_EnableIRQ(EPWM0P1_IRQn);
+    void encodePins(uint32_t mask, size_t index, const color::rgba<uint16_t> &pixel) {
+        slots::encode<protocol>(&buffers[back][index * Leds::bitsPerLed * slots::slotsPerBit], mask, pixel);
+    }
 
-    pwm0Buf = birdsLedsDMABuf[0].data();
-    pwm0BufEnd = pwm0Buf + birdsLedsDMABuf[0].size();
+    void copyPins(uint32_t mask, size_t index) {
+        size_t last = ( back + Leds::bufferN - 1 ) % Leds::bufferN;
+        slots::copy(&buffers[back][index * Leds::bitsPerLed * slots::slotsPerBit], &buffers[last][index * Leds::bitsPerLed * slots::slotsPerBit], mask, Leds::bitsPerLed);
+    }
 
-    EPWM_SET_CMR(EPWM0, 3, *pwm0Buf++);
-#else  // #ifndef USE_PWM_DMA
-    EPWM_SET_CMR(EPWM0, 3, 0x0);
-#endif  // #ifndef USE_DMA
+    std::array<std::array<uint32_t, ( Leds::birdLedsN * Leds::bitsPerLed + extraPadding ) * slots::slotsPerBit>, Leds::bufferN> buffers __attribute__ ((aligned (16)));
+    size_t back = 0;
+    volatile bool active = false;
+};
 
-    EPWM_SET_CNR(EPWM0, 3, 0x100);
+using BirdTransport = GPIODMABirdTransport;
 
-    // BOTTOM_LED_BIRD
-    PB13 = 0;
+#elif defined(USE_PWM)
 
-    SYS->GPB_MFPH &= ~(SYS_GPB_MFPH_PB13MFP_Msk);
-    SYS->GPB_MFPH |= (SYS_GPB_MFPH_PB13MFP_EPWM1_CH2);
+class PWMBirdTransport {
+public:
+    void init() {
+        // TOP_LED_BIRD
+        CLK_SetModuleClock(EPWM0_MODULE, CLK_CLKSEL2_EPWM0SEL_PLL, 0); // 96Mhz
+        CLK_EnableModuleClock(EPWM0_MODULE);
 
-    EPWM_ConfigOutputChannel(EPWM1, 2, 800000, 0);
-    EPWM_SET_PRESCALER(EPWM1, 2, 0);
-    EPWM_EnableOutput(EPWM1, EPWM_CH_2_MASK);
+        // BOTTOM_LED_BIRD
+        CLK_SetModuleClock(EPWM1_MODULE, CLK_CLKSEL2_EPWM1SEL_PLL, 0); // 96Mhz
+        CLK_EnableModuleClock(EPWM1_MODULE);
 
-#ifndef USE_PWM_DMA
-    EPWM_EnableZeroInt(EPWM1, 2);
-    NVIC_SetPriority(EPWM1P1_IRQn, 0);
-    NVIC_EnableIRQ(EPWM1P1_IRQn);
+        for (auto &buffer : buffers) {
+            for (auto &side : buffer) {
+                for (size_t c = Leds::birdLedsN * encoding::bytesPerLed; c < side.size(); c++) {
+                    side[c] = 0;
+                }
+            }
+        }
+    }
 
-    pwm1Buf = birdsLedsDMABuf[1].data();
-    pwm1BufEnd = pwm1Buf + birdsLedsDMABuf[1].size();
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encoding::encode(reinterpret_cast<uint32_t *>(&buffers[back][side][index * encoding::bytesPerLed]), pixel);
+    }
 
-    EPWM_SET_CMR(EPWM1, 2, *pwm1Buf++);
-#else  // #ifndef USE_PWM_DMA
-    EPWM_SET_CMR(EPWM1, 2, 0x0);
-#endif  // #ifdef USE_DMA
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        encode(0, index, pixel);
+        memcpy(&buffers[back][1][mirrorIndex * encoding::bytesPerLed], &buffers[back][0][index * encoding::bytesPerLed], encoding::bytesPerLed);
+    }
+
+    void copy(size_t side, size_t index) {
+        size_t last = ( back + Leds::bufferN - 1 ) % Leds::bufferN;
+        memcpy(&buffers[back][side][index * encoding::bytesPerLed], &buffers[last][side][index * encoding::bytesPerLed], encoding::bytesPerLed);
+    }
+
+    void copyMirrored(size_t index, size_t mirrorIndex) {
+        copy(0, index);
+        copy(1, mirrorIndex);
+    }
 
-    EPWM_SET_CNR(EPWM1, 2, 0x100);
+    void start() {
+        wait();
 
-#ifdef USE_PWM_DMA
-    EPWM0->PDMACTL = EPWM_PDMACTL_CHEN2_3_Msk | EPWM_PDMACTL_CHSEL2_3_Msk;
-    EPWM1->PDMACTL = EPWM_PDMACTL_CHEN2_3_Msk;
+        auto &front = buffers[back];
+        back = ( back + 1 ) % Leds::bufferN;
 
-    PDMA_SetTransferCnt(PDMA,EPWM0_TX_DMA_CH, PDMA_WIDTH_8, birdsLedsDMABuf[0].size());
-    PDMA_SetTransferMode(PDMA,EPWM0_TX_DMA_CH, PDMA_EPWM0_CH3_TX, FALSE, 0);
+        pwmTransferActive = true;
 
-    PDMA_SetTransferCnt(PDMA,EPWM1_TX_DMA_CH, PDMA_WIDTH_8, birdsLedsDMABuf[1].size());
-    PDMA_SetTransferMode(PDMA,EPWM1_TX_DMA_CH, PDMA_EPWM0_CH2_TX, FALSE, 0);
+        // TOP_LED_BIRD
+        PB2 = 0;
 
-    // Note: Nothing happens. I assume the chip does not support DMA transfer like STM32s/NXPs.
-    EPWM_Start(EPWM0, EPWM_CH_3_MASK);
-    EPWM_Start(EPWM1, EPWM_CH_2_MASK);
-#else  // #ifdef USE_DMA
-    // Start Top
-    EPWM_Start(EPWM0, EPWM_CH_3_MASK);
-#endif  // #ifdef USE_DMA
+        SYS->GPB_MFPL &= ~(SYS_GPB_MFPL_PB2MFP_Msk);
+        SYS->GPB_MFPL |= (SYS_GPB_MFPL_PB2MFP_EPWM0_CH3);
 
-#else  // #ifdef USE_PWM
+        EPWM_ConfigOutputChannel(EPWM0, 3, 800000, 0);
+        EPWM_SET_PRESCALER(EPWM0, 3, 0);
+        EPWM_EnableOutput(EPWM0, EPWM_CH_3_MASK);
+
+        EPWM_EnableZeroInt(EPWM0, 3);
+        NVIC_SetPriority(EPWM0P1_IRQn, 0);
+        NVIC_EnableIRQ(EPWM0P1_IRQn);
+
+        pwm0Buf = front[0].data();
+        pwm0BufEnd = pwm0Buf + front[0].size();
+
+        EPWM_SET_CMR(EPWM0, 3, *pwm0Buf++);
+        EPWM_SET_CNR(EPWM0, 3, 0x100);
+
+        // BOTTOM_LED_BIRD
+        PB13 = 0;
+
+        SYS->GPB_MFPH &= ~(SYS_GPB_MFPH_PB13MFP_Msk);
+        SYS->GPB_MFPH |= (SYS_GPB_MFPH_PB13MFP_EPWM1_CH2);
+
+        EPWM_ConfigOutputChannel(EPWM1, 2, 800000, 0);
+        EPWM_SET_PRESCALER(EPWM1, 2, 0);
+        EPWM_EnableOutput(EPWM1, EPWM_CH_2_MASK);
+
+        EPWM_EnableZeroInt(EPWM1, 2);
+        NVIC_SetPriority(EPWM1P1_IRQn, 0);
+        NVIC_EnableIRQ(EPWM1P1_IRQn);
+
+        pwm1Buf = front[1].data();
+        pwm1BufEnd = pwm1Buf + front[1].size();
+
+        EPWM_SET_CMR(EPWM1, 2, *pwm1Buf++);
+        EPWM_SET_CNR(EPWM1, 2, 0x100);
+
+        // Start Top
+        EPWM_Start(EPWM0, EPWM_CH_3_MASK);
+    }
+
+    void wait() {
+        while (pwmTransferActive) {}
+    }
+
+    void stop() {
+        EPWM_ForceStop(EPWM0, EPWM_CH_3_MASK);
+        EPWM_ForceStop(EPWM1, EPWM_CH_2_MASK);
+        pwmTransferActive = false;
+    }
+
+private:
+    using encoding = SegmentEncoder<Leds::birdSegment(0), onewire::pwm_duty>;
+
+    static constexpr size_t extraBirdPadding = encoding::bytesPerLed * 2; // Need padding for PWM
+
+    std::array<std::array<std::array<uint8_t, Leds::birdLedsN * encoding::bytesPerLed + extraBirdPadding>, Leds::sidesN>, Leds::bufferN> buffers __attribute__ ((aligned (16)));
+    size_t back = 0;
+};
+
+using BirdTransport = PWMBirdTransport;
+
+#else  // #if defined(USE_GPIO_DMA)
+
+class BitBangBirdTransport {
+public:
+    void init() {
+    }
+
+    void encode(size_t side, size_t index, const color::rgba<uint16_t> &pixel) {
+        encoding::encode(reinterpret_cast<uint32_t *>(&buffer[side][index * encoding::bytesPerLed]), pixel);
+    }
+
+    void encodeMirrored(size_t index, size_t mirrorIndex, const color::rgba<uint16_t> &pixel) {
+        encode(0, index, pixel);
+        memcpy(&buffer[1][mirrorIndex * encoding::bytesPerLed], &buffer[0][index * encoding::bytesPerLed], encoding::bytesPerLed);
+    }
+
+    // The one buffer already holds it
+    void copy(size_t, size_t) {
+    }
+
+    void copyMirrored(size_t, size_t) {
+    }
+
+    void start() {
 
 #define DELAY() \
     asm volatile ("nop"::); \
@@ -378,37 +639,173 @@ void Leds::transfer() {
     asm volatile ("nop"::); \
     asm volatile ("nop"::);
 
-    __disable_irq();
-    PB2 = 0;
-    PB13 = 0;
-    for (size_t c = 0; c < birdsLedsDMABuf[0].size(); c++) {
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 7) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 7) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 6) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 6) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 5) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 5) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 4) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 4) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 3) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 3) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 2) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 2) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 1) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 1) & 1;
-        DELAY();
-        PB2 = (birdsLedsDMABuf[0][c] >> 0) & 1;
-        PB13 = (birdsLedsDMABuf[1][c] >> 0) & 1;
+        __disable_irq();
+        PB2 = 0;
+        PB13 = 0;
+        for (size_t c = 0; c < buffer[0].size(); c++) {
+            DELAY();
+            PB2 = (buffer[0][c] >> 7) & 1;
+            PB13 = (buffer[1][c] >> 7) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 6) & 1;
+            PB13 = (buffer[1][c] >> 6) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 5) & 1;
+            PB13 = (buffer[1][c] >> 5) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 4) & 1;
+            PB13 = (buffer[1][c] >> 4) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 3) & 1;
+            PB13 = (buffer[1][c] >> 3) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 2) & 1;
+            PB13 = (buffer[1][c] >> 2) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 1) & 1;
+            PB13 = (buffer[1][c] >> 1) & 1;
+            DELAY();
+            PB2 = (buffer[0][c] >> 0) & 1;
+            PB13 = (buffer[1][c] >> 0) & 1;
+        }
+        PB2 = 0;
+        PB13 = 0;
+        __enable_irq();
+    }
+
+    void wait() {
+    }
+
+    void stop() {
+    }
+
+private:
+    // Bits are shifted out of the buffer bytes MSB first
+    using encoding = SegmentEncoder<Leds::birdSegment(0), onewire::spi_nibble<8>>;
+
+    // Sent synchronously, no need for a second buffer
+    std::array<std::array<uint8_t, Leds::birdLedsN * encoding::bytesPerLed>, Leds::sidesN> buffer __attribute__ ((aligned (16)));
+};
+
+using BirdTransport = BitBangBirdTransport;
+
+#endif  // #if defined(USE_GPIO_DMA)
+
+static RingTransport ringTransport;
+static BirdTransport birdTransport;
+
+Leds &Leds::instance() {
+    static Leds leds;
+    if (!leds.initialized) {
+        leds.initialized = true;
+        leds.init();
     }
+    return leds;
+}
+
+struct Leds::Map Leds::map;
+
+void Leds::init() {
+
+    // LED_ON
+    GPIO_SetMode(PF, BIT3, GPIO_MODE_OUTPUT);
+
+    half();
+
+    // Turn Mosfet on
+    PF3 = 0;
+    powered = true;
+
+    GPIO_SetMode(PB, BIT2, GPIO_MODE_OUTPUT);
     PB2 = 0;
+
+    GPIO_SetMode(PB, BIT13, GPIO_MODE_OUTPUT);
     PB13 = 0;
-    __enable_irq();
-#endif // #ifdef USE_PWM
+
+    ringTransport.init();
+    birdTransport.init();
+}
+
+void Leds::setSymmetry(Symmetry symmetry) {
+    if (symmetryMode == symmetry) {
+        return;
+    }
+    symmetryMode = symmetry;
+    // Side 1 changes hands, start over with a full frame
+    lit.fill(false);
+    sentValid = false;
+}
+
+void Leds::powerOff() {
+    // Let the last black frame latch before dropping the rail
+    ringTransport.wait();
+    birdTransport.wait();
+
+    // Turn Mosfet off
+    PF3 = 1;
+    powered = false;
+}
+
+void Leds::powerOn() {
+    // Turn Mosfet on
+    PF3 = 0;
+    powered = true;
+
+    // Frames prepared while the rail was off were never flipped out,
+    // re-encode everything so both buffers are consistent again.
+    stale.fill(bufferN);
+
+    delay_us(powerOnSettleTimeUs);
+}
+
+void Leds::PDMA_IRQHandler() {
+#ifdef USE_SPI_STREAM
+    ringTransport.pdmaDone();
+#endif  // #ifdef USE_SPI_STREAM
+#ifdef USE_GPIO_DMA
+    birdTransport.pdmaDone();
+#endif  // #ifdef USE_GPIO_DMA
+}
+
+void Leds::forceStop() {
+    ringTransport.stop();
+    birdTransport.stop();
+}
+
+__attribute__ ((hot, optimize("Os"), flatten))
+void Leds::transfer() {
+    float brightness = Model::instance().Brightness();
+
+    if (!markChanged(brightness)) {
+        // Same frame as last time, only the black frame counter moves
+        if (sentBlack && powered && ++blackFrames >= blackFramesBeforePowerOff) {
+            powerOff();
+        }
+        sentSettled = !sentBlack || !powered;
+        return;
+    }
+    sentSettled = false;
+
+    sentBlack = prepare(brightness, ringTransport, birdTransport);
+
+    if (sentBlack) {
+        if (!powered) {
+            return;
+        }
+        if (++blackFrames >= blackFramesBeforePowerOff) {
+            ringTransport.start();
+            birdTransport.start();
+            powerOff();
+            return;
+        }
+    } else {
+        blackFrames = 0;
+        if (!powered) {
+            powerOn();
+            prepare(brightness, ringTransport, birdTransport);
+        }
+    }
+
+    ringTransport.start();
+    birdTransport.start();
 }
@@ -24,73 +24,95 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define LEDS_H_
 
 #include "./color.h"
+#include "./layout.h"
 
 #include <numbers>
 #include <cmath>
+#include <span>
+#include <utility>
 
 #define USE_SPI_DMA 1
-//#define USE_PWM_DMA 1
-#define USE_PWM 1
-
-extern "C" {
-    void EPWM0P1_IRQHandler(void);
-    void EPWM1P1_IRQHandler(void);
-};
+//#define USE_SPI_STREAM 1
+#define USE_GPIO_DMA 1
+//#define USE_PWM 1
+//#define USE_FLOAT_TRANSFER 1
 
 class Leds {
 public:
+    using topology = layout::pendant;
+
     static constexpr size_t sidesN = 2;
-    static constexpr size_t circleLedsN = 32;
-    static constexpr size_t birdLedsN = 8;
-    static constexpr size_t ledsN = ( circleLedsN + birdLedsN ) * sidesN;
+    static constexpr size_t circleLedsN = topology::segment<0>::ledsN;
+    static constexpr size_t birdLedsN = topology::segment<sidesN>::ledsN;
+    static constexpr size_t ledsN = topology::ledsN;
+
+    // Segment index of the ring and the bird of a side
+    static constexpr size_t circleSegment(size_t side) { return side; }
+    static constexpr size_t birdSegment(size_t side) { return sidesN + side; }
+
+    static constexpr size_t bitsPerComponent = 16;
+    static constexpr size_t bitsPerLed = bitsPerComponent * 3;
+
+    static constexpr size_t bufferN = 2;
 
     static Leds &instance();
 
     void apply() { transfer(); }
 
+    // The rail is off after a run of black frames, nothing is in flight and nothing needs a refresh
+    bool dark() const { return !powered; }
+
+    // The last frame was the same as the one before, and no run of black frames is counting
+    // down to turning the rail off
+    bool settled() const { return sentSettled; }
+
+    // In Mirrored mode only side 0 is rendered and converted, side 1 shows the same
+    // frame with the ring running in the opposite direction.
+    enum Symmetry {
+        None,
+        Mirrored
+    };
+
+    void setSymmetry(Symmetry symmetry);
+    Symmetry symmetry() const { return symmetryMode; }
+
+    // Positions of every LED in framebuffer order, generated from the shapes of all segments
     static struct Map {
         
         consteval Map() : map() {
-            float i = - float(std::numbers::pi) * 0.5f;
-            float j = 0;
-            for (size_t c = 0; c < circleLedsN; c++) {
-                map[c].x =  cosf(i);
-                map[c].y = -sinf(i);
-                map[c].z = j;
-                map[c].w = i;
-                i += 2.0f * float(std::numbers::pi) / float(circleLedsN);
-                j += 1.0f / float(circleLedsN);
-            }
-            map[circleLedsN + 0] = vector::float4(  0.0f,  12.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 1] = vector::float4(-11.0f,   5.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 2] = vector::float4( -7.0f,   0.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 3] = vector::float4(  0.0f,   0.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 4] = vector::float4(  7.0f,   0.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 5] = vector::float4( 11.0f,   5.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 6] = vector::float4(  0.0f,  -8.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            map[circleLedsN + 7] = vector::float4(  0.0f,- 16.0f, 0.0f, 0.0f ) * (1.0f / 25.0f);
-            for (size_t c = circleLedsN; c < (circleLedsN + birdLedsN); c++) {
-                map[c].w = sqrtf(map[c].x * map[c].x + map[c].y * map[c].y);
-            }
+            fill(std::make_index_sequence<topology::segmentsN>());
         }
 
         vector::float4 get(size_t index) const {
-            index %= circleLedsN + birdLedsN;
-            return map[index];
+            return map[index % ledsN];
+        }
+
+        vector::float4 get(size_t segment, size_t index) const {
+            segment %= topology::segmentsN;
+            return map[topology::index(segment, index % topology::counts[segment])];
         }
 
         vector::float4 getCircle(size_t index) const {
-            index %= circleLedsN;
-            return map[index];
+            return get(circleSegment(0), index);
         }
 
         vector::float4 getBird(size_t index) const {
-            index %= birdLedsN;
-            return map[circleLedsN + index];
+            return get(birdSegment(0), index);
         }
 
     private:
-        vector::float4 map[circleLedsN + birdLedsN];
+        template<size_t... S> consteval void fill(std::index_sequence<S...>) {
+            ( fill<S>(), ... );
+        }
+
+        template<size_t S> consteval void fill() {
+            using shape = typename topology::segment<S>::shape;
+            for (size_t c = 0; c < shape::ledsN; c++) {
+                map[topology::index(S, c)] = shape::position(c);
+            }
+        }
+
+        vector::float4 map[ledsN];
     } map;
 
     void black() {
@@ -112,86 +134,80 @@ public:
     }
 
     void set(size_t index, const vector::float4 &c) {
-        get(index) = c;
+        leds[index % ledsN] = c;
     }
 
-    vector::float4 &get(size_t index) {
-        index %= 2 * ( circleLedsN + birdLedsN );
-        if (index >= 2 * circleLedsN + birdLedsN) {
-            return birdLeds[1][index - (2 * circleLedsN + birdLedsN)];
-        } else if (index >= 2 * circleLedsN) {
-            return birdLeds[0][index - (2 * circleLedsN)];
-        } else if (index >= circleLedsN) {
-            return circleLeds[1][index - circleLedsN];
-        } else {
-            return circleLeds[0][index];
-        }
+    vector::float4 get(size_t index) const {
+        return leds[index % ledsN];
     }
 
     void setCircle(size_t side, size_t index, const vector::float4 &c) {
-        getCircle(side, index) = c;
+        circle(side)[index % circleLedsN] = c;
     }
 
-    vector::float4 &getCircle(size_t side, size_t index) {
-        side %= sidesN;
-        index %= circleLedsN;
-        return circleLeds[side][index];
+    vector::float4 getCircle(size_t side, size_t index) {
+        return circle(side)[index % circleLedsN];
     }
 
     void setBird(size_t side, size_t index, const vector::float4 &c) {
-        getBird(side, index) = c;
+        bird(side)[index % birdLedsN] = c;
     }
 
-    vector::float4 &getBird(size_t side, size_t index) {
+    vector::float4 getBird(size_t side, size_t index) {
+        return bird(side)[index % birdLedsN];
+    }
+
+    // Views into the framebuffer, laid out as circle 0, circle 1, bird 0, bird 1
+    std::span<color::luv16, ledsN> frame() {
+        return leds;
+    }
+
+    std::span<color::luv16, circleLedsN> circle(size_t side) {
         side %= sidesN;
-        index %= birdLedsN;
-        return birdLeds[side][index];
+        return std::span<color::luv16, circleLedsN>(&leds[topology::offsets[circleSegment(side)]], circleLedsN);
     }
 
-    auto getCircle() { return circleLeds; }
-    auto getBird() { return birdLeds; };
-    void setCircle(auto _circleLeds) { circleLeds = _circleLeds; }
-    void setBird(auto _birdLeds) { birdLeds = _birdLeds; }
+    std::span<color::luv16, birdLedsN> bird(size_t side) {
+        side %= sidesN;
+        return std::span<color::luv16, birdLedsN>(&leds[topology::offsets[birdSegment(side)]], birdLedsN);
+    }
 
     void forceStop();
 
+    // Encode stage of transfer(), see ledsprepare.h. markChanged() returns whether the frame or
+    // the brightness changed since the last call, prepare() encodes what is stale into the back
+    // buffers of the transports and returns whether the frame is black.
+    bool markChanged(float brightness);
+    template<class Ring, class Bird> bool prepare(float brightness, Ring &ring, Bird &bird);
+
+    // Completion of the transports which run off PDMA interrupts
+    void PDMA_IRQHandler();
+
 private:
-    friend void EPWM0P1_IRQHandler(void);
-    friend void EPWM1P1_IRQHandler(void);
-
-    static const struct lut_table {
-        consteval lut_table() {
-            for (uint32_t c = 0; c < 256; c++) {
-                table[c] = 0x88888888 |
-                        (((c >>  4) | (c <<  6) | (c << 16) | (c << 26)) & 0x04040404)|
-                        (((c >>  1) | (c <<  9) | (c << 19) | (c << 29)) & 0x40404040);
-            }
-        }
+    std::array<color::luv16, ledsN> leds;
 
-        uint32_t operator[](size_t index) const {
-            return table[index];
-        }
+    Symmetry symmetryMode = None;
 
-    private:
-        uint32_t table[256];
-    } lut;
+    // Last frame handed to the transports, used to skip unchanged frames
+    std::array<color::luv16, ledsN> sentLeds;
+    float sentBrightness = 0.0f;
+    bool sentValid = false;
+    bool sentBlack = false;
+    bool sentSettled = false;
 
-    std::array<std::array<vector::float4, circleLedsN>, sidesN> circleLeds;
-    std::array<std::array<vector::float4, birdLedsN>, sidesN> birdLeds;
+    // Per LED count of encode buffers which still hold an old encoding
+    std::array<uint8_t, ledsN> stale {};
+    std::array<bool, ledsN> lit {};
 
-    static constexpr size_t bitsPerComponent = 16;
-    static constexpr size_t bitsPerLed = bitsPerComponent * 3;
+    static constexpr size_t blackFramesBeforePowerOff = 240;
+    static constexpr int powerOnSettleTimeUs = 1000;
+    size_t blackFrames = 0;
+    bool powered = false;
 
-#ifdef USE_PWM
-    static constexpr size_t extraBirdPadding = bitsPerLed * 2; // Need padding for PWM
-    std::array<std::array<uint8_t, birdLedsN * bitsPerLed + extraBirdPadding>, sidesN> birdsLedsDMABuf __attribute__ ((aligned (16)));
-#else  // #ifdef USE_PWM
-    std::array<std::array<uint8_t, (birdLedsN * bitsPerLed) / 2>, sidesN> birdsLedsDMABuf __attribute__ ((aligned (16)));
-#endif  // #ifdef USE_PWM
-    std::array<std::array<uint8_t, (circleLedsN * bitsPerLed) / 2>, sidesN> circleLedsDMABuf __attribute__ ((aligned (16)));
+    void powerOn();
+    void powerOff();
 
     void transfer();
-    void prepare();
 
     void init();
     bool initialized = false;
@@ -0,0 +1,130 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef LEDSPREPARE_H_
+#define LEDSPREPARE_H_
+
+#include "./leds.h"
+#include "./color.h"
+#include "./profiler.h"
+
+// Encode stage of Leds::transfer(). Free of hardware so the host encode tool runs the same code
+// against stand-in transports, see the transport interface in leds.cpp.
+
+inline bool Leds::markChanged(float brightness) {
+    bool changed = false;
+    if (!sentValid || brightness != sentBrightness) {
+        sentValid = true;
+        sentBrightness = brightness;
+        stale.fill(bufferN);
+        changed = true;
+    }
+    auto mark = [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; c++) {
+            if (leds[c] != sentLeds[c]) {
+                sentLeds[c] = leds[c];
+                // Both ping-pong buffers hold an old encoding of this LED now
+                stale[c] = bufferN;
+                changed = true;
+            }
+        }
+    };
+    if (symmetryMode == Mirrored) {
+        // Side 1 is never looked at
+        mark(topology::offsets[circleSegment(0)], topology::offsets[circleSegment(0)] + circleLedsN);
+        mark(topology::offsets[birdSegment(0)], topology::offsets[birdSegment(0)] + birdLedsN);
+    } else {
+        mark(0, ledsN);
+    }
+    return changed;
+}
+
+template<class Ring, class Bird> bool Leds::prepare(float brightness, Ring &ring, Bird &bird) {
+    Profiler::Scope profile(Profiler::LedPrepare);
+    static color::convert converter;
+
+    auto convert = [brightness](const color::luv16 &c) {
+#ifdef USE_FLOAT_TRANSFER
+        return color::rgba<uint16_t>(converter.CIELUV2sRGB(c.scaled(brightness)));
+#else  // #ifdef USE_FLOAT_TRANSFER
+        return converter.CIELUV2sRGB16(c.scaled(brightness));
+#endif  // #ifdef USE_FLOAT_TRANSFER
+    };
+
+    // Only LEDs which are stale in the back buffer are touched. One which changed this frame is
+    // converted and encoded, one which changed before is already encoded in the buffer sent last
+    // and only copied over. Every prepare() while powered is followed by a send, so that buffer
+    // is the one prepared last; while the rail is off powerOn() marks everything changed again.
+    auto encode = [&](auto &transport, size_t side, size_t index, size_t i) {
+        if (stale[i] == bufferN) {
+            color::rgba<uint16_t> pixel(convert(leds[i]));
+            lit[i] = ( pixel.r | pixel.g | pixel.b ) != 0;
+            transport.encode(side, index, pixel);
+        } else if (stale[i]) {
+            transport.copy(side, index);
+        } else {
+            return;
+        }
+        stale[i]--;
+    };
+
+    // Side 0 is converted once and copied into side 1, rings run the other way around
+    auto encodeMirrored = [&](auto &transport, size_t index, size_t mirrorIndex, size_t i) {
+        if (stale[i] == bufferN) {
+            color::rgba<uint16_t> pixel(convert(leds[i]));
+            lit[i] = ( pixel.r | pixel.g | pixel.b ) != 0;
+            transport.encodeMirrored(index, mirrorIndex, pixel);
+        } else if (stale[i]) {
+            transport.copyMirrored(index, mirrorIndex);
+        } else {
+            return;
+        }
+        stale[i]--;
+    };
+
+    if (symmetryMode == Mirrored) {
+        for (size_t c = 0; c < circleLedsN; c++) {
+            encodeMirrored(ring, c, circleLedsN - 1 - c, topology::index(circleSegment(0), c));
+        }
+        for (size_t c = 0; c < birdLedsN; c++) {
+            encodeMirrored(bird, c, c, topology::index(birdSegment(0), c));
+        }
+    } else {
+        for (size_t s = 0; s < sidesN; s++) {
+            for (size_t c = 0; c < circleLedsN; c++) {
+                encode(ring, s, c, topology::index(circleSegment(s), c));
+            }
+            for (size_t c = 0; c < birdLedsN; c++) {
+                encode(bird, s, c, topology::index(birdSegment(s), c));
+            }
+        }
+    }
+
+    for (size_t c = 0; c < ledsN; c++) {
+        if (lit[c]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif /* LEDSPREPARE_H_ */
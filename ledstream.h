@@ -0,0 +1,91 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef LEDSTREAM_H_
+#define LEDSTREAM_H_
+
+#include <array>
+#include <span>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// Streams a one-wire chain through a fixed ring of small encode chunks instead of a
+// buffer holding the whole encoded frame, so RAM use does not depend on chain length.
+//
+// begin() encodes the first chunks of a frame and returns the one to send first. Whenever
+// a chunk is out the DMA completion interrupt calls next() to get the following chunk,
+// starts it and then calls refill() to encode ahead into the chunk which just went out.
+// An empty span from next() means the frame is complete.
+//
+// The encoder is called as encoder(uint32_t *dst, size_t index) and writes WordsPerLed words.
+namespace ledstream {
+
+    template<size_t WordsPerLed, size_t ChunkLedsN, size_t ChunksN = 2> class chunked {
+    public:
+        static_assert(ChunksN >= 2, "Need at least one chunk to send while the other one is encoded");
+
+        static constexpr size_t wordsPerChunk = WordsPerLed * ChunkLedsN;
+
+        template<class Encoder> std::span<const uint32_t> begin(size_t ledsN, Encoder &&encoder) {
+            frameLedsN = ledsN;
+            encodedN = 0;
+            current = 0;
+            for (size_t c = 0; c < ChunksN; c++) {
+                fill(c, encoder);
+            }
+            return chunk(current);
+        }
+
+        std::span<const uint32_t> next() {
+            current = ( current + 1 ) % ChunksN;
+            return chunk(current);
+        }
+
+        template<class Encoder> void refill(Encoder &&encoder) {
+            fill(( current + ChunksN - 1 ) % ChunksN, encoder);
+        }
+
+    private:
+        template<class Encoder> void fill(size_t slot, Encoder &encoder) {
+            size_t n = std::min(ChunkLedsN, frameLedsN - encodedN);
+            for (size_t c = 0; c < n; c++) {
+                encoder(&chunks[slot][c * WordsPerLed], encodedN + c);
+            }
+            counts[slot] = n;
+            encodedN += n;
+        }
+
+        std::span<const uint32_t> chunk(size_t slot) const {
+            return std::span<const uint32_t>(chunks[slot].data(), counts[slot] * WordsPerLed);
+        }
+
+        std::array<std::array<uint32_t, wordsPerChunk>, ChunksN> chunks __attribute__ ((aligned (16)));
+        std::array<size_t, ChunksN> counts {};
+        size_t frameLedsN = 0;
+        size_t encodedN = 0;
+        size_t current = 0;
+    };
+
+}
+
+#endif /* LEDSTREAM_H_ */
@@ -130,6 +130,8 @@ static void SYS_Init(void)
     CLK_EnableModuleClock(I2C0_MODULE); // PCLK0, 12Mhz
     CLK_EnableModuleClock(PDMA_MODULE); // HCLK, 96Mhz
 
+    CLK_EnableModuleClock(TRNG_MODULE); // PCLK, 96Mhz
+
     CLK_EnableModuleClock(QSPI0_MODULE);
     CLK_SetModuleClock(QSPI0_MODULE, CLK_CLKSEL2_QSPI0SEL_PLL, MODULE_NoMsk); // 96Mhz
 
@@ -159,6 +161,7 @@ static void SYS_DeInit(void)
     CLK_DisableModuleClock(UART1_MODULE);
     CLK_DisableModuleClock(TMR0_MODULE);
     CLK_DisableModuleClock(TMR1_MODULE);
+    CLK_DisableModuleClock(TMR2_MODULE);
 }
 
 int main(void)
@@ -0,0 +1,213 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef ONEWIRE_H_
+#define ONEWIRE_H_
+
+#include "./color.h"
+#include "./layout.h"
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// One-wire LED encoders, generated at compile time from three parts:
+//
+//  Protocol    bits per component, default order and any value fixups the LEDs need
+//  Wire        how one LED bit is represented on the transport
+//  Order       which components go out, in wire order
+//
+// Every Wire expands a full input byte per table lookup. encoder<>::encode() writes
+// wordsPerLed words and returns the pointer past them.
+namespace onewire {
+
+    // Component orders, indices are r, g, b, w (taken from alpha)
+
+    template<size_t... C> struct order {
+        static constexpr size_t componentsN = sizeof...(C);
+
+        template<size_t I> static constexpr uint16_t component(const color::rgba<uint16_t> &pixel) {
+            static_assert(I < 4);
+            if constexpr (I == 0) return pixel.r;
+            if constexpr (I == 1) return pixel.g;
+            if constexpr (I == 2) return pixel.b;
+            if constexpr (I == 3) return pixel.a;
+        }
+
+        template<class F> static constexpr void each(const color::rgba<uint16_t> &pixel, F &&f) {
+            ( f(component<C>(pixel)), ... );
+        }
+    };
+
+    using rgb = order<0, 1, 2>;
+    using grb = order<1, 0, 2>;
+    using grbw = order<1, 0, 2, 3>;
+
+    // Protocols, each with the component order the LEDs expect by default
+
+    struct ws2812 {
+        using order = grb;
+        static constexpr size_t bitsPerComponent = 8;
+        static constexpr color::rgba<uint16_t> fix(const color::rgba<uint16_t> &pixel) { return pixel; }
+    };
+
+    struct ws2816 {
+        using order = grb;
+        static constexpr size_t bitsPerComponent = 16;
+        static color::rgba<uint16_t> fix(color::rgba<uint16_t> pixel) { return pixel.fix_for_ws2816(); }
+    };
+
+    struct sk6812 {
+        using order = grbw;
+        static constexpr size_t bitsPerComponent = 8;
+        static constexpr color::rgba<uint16_t> fix(const color::rgba<uint16_t> &pixel) { return pixel; }
+    };
+
+    template<layout::protocol P> struct protocol_of;
+    template<> struct protocol_of<layout::protocol::ws2812> { using type = ws2812; };
+    template<> struct protocol_of<layout::protocol::ws2816> { using type = ws2816; };
+    template<> struct protocol_of<layout::protocol::sk6812> { using type = sk6812; };
+
+    // Wires
+
+    // 4 SPI bits per LED bit, 1000 for a zero and 1100 for a one. With FrameBits == 32
+    // the words are pre-swapped for SPI shifting 32-bit frames MSB first, with
+    // FrameBits == 8 they are in byte stream order.
+    template<size_t FrameBits> struct spi_nibble {
+        static_assert(FrameBits == 8 || FrameBits == 32);
+
+        using word = uint32_t;
+        static constexpr size_t wordsPerByte = 1;
+
+        static constexpr std::array<word, 256> table = [] {
+            std::array<word, 256> t {};
+            for (uint32_t c = 0; c < 256; c++) {
+                uint32_t w = 0;
+                for (uint32_t b = 0; b < 4; b++) {
+                    uint32_t hi = ( c >> ( 7 - b * 2 ) ) & 1;
+                    uint32_t lo = ( c >> ( 6 - b * 2 ) ) & 1;
+                    uint32_t byte = 0x88 | ( hi << 6 ) | ( lo << 2 );
+                    w |= ( FrameBits == 32 ? byte << ( ( 3 - b ) * 8 ) : byte << ( b * 8 ) );
+                }
+                t[c] = w;
+            }
+            return t;
+        }();
+
+        static word *expand(word *p, uint8_t v) {
+            *p++ = table[v];
+            return p;
+        }
+    };
+
+    // One EPWM compare byte per LED bit, little endian byte stream order
+    struct pwm_duty {
+        static constexpr uint8_t zero = 0x20;
+        static constexpr uint8_t one = 0x40;
+
+        using word = uint32_t;
+        static constexpr size_t wordsPerByte = 2;
+
+        static constexpr std::array<word, 256 * wordsPerByte> table = [] {
+            std::array<word, 256 * wordsPerByte> t {};
+            for (uint32_t c = 0; c < 256; c++) {
+                for (uint32_t b = 0; b < 8; b++) {
+                    uint32_t duty = ( ( c >> ( 7 - b ) ) & 1 ) ? one : zero;
+                    t[c * wordsPerByte + b / 4] |= duty << ( ( b % 4 ) * 8 );
+                }
+            }
+            return t;
+        }();
+
+        static word *expand(word *p, uint8_t v) {
+            *p++ = table[v * wordsPerByte + 0];
+            *p++ = table[v * wordsPerByte + 1];
+            return p;
+        }
+    };
+
+    // Port words for PDMA writes to a GPIO DOUT register, so chains on the same port go out in
+    // parallel. Every LED bit takes slotsPerBit words: high, data, low, low. At the SPI rate a
+    // zero is 1000 and a one 1100, the same waveform as spi_nibble.
+    struct gpio_slots {
+        static constexpr uint32_t slotRate = 4000000;
+        static constexpr size_t slotsPerBit = 4;
+
+        // Fixed parts of bitsN bits for the pins in mask
+        static void prepare(uint32_t *p, uint32_t mask, size_t bitsN) {
+            for (size_t c = 0; c < bitsN; c++, p += slotsPerBit) {
+                p[0] |= mask;
+                for (size_t s = 1; s < slotsPerBit; s++) {
+                    p[s] &= ~mask;
+                }
+            }
+        }
+
+        // Data slots of one LED, p points at the first slot of its first bit
+        template<class Protocol, class Order = typename Protocol::order>
+        static uint32_t *encode(uint32_t *p, uint32_t mask, const color::rgba<uint16_t> &pixel) {
+            p += 1;
+            Order::each(Protocol::fix(pixel), [&p, mask](uint16_t v) {
+                v >>= 16 - Protocol::bitsPerComponent;
+                for (size_t b = 0; b < Protocol::bitsPerComponent; b++) {
+                    *p = ( *p & ~mask ) | ( mask & ( 0 - ( ( uint32_t(v) >> ( Protocol::bitsPerComponent - 1 - b ) ) & 1 ) ) );
+                    p += slotsPerBit;
+                }
+            });
+            return p - 1;
+        }
+
+        // Data slots of bitsN bits for the pins in mask, taken from an earlier encode at src
+        static void copy(uint32_t *p, const uint32_t *src, uint32_t mask, size_t bitsN) {
+            for (size_t c = 0; c < bitsN; c++, p += slotsPerBit, src += slotsPerBit) {
+                p[1] = ( p[1] & ~mask ) | ( src[1] & mask );
+            }
+        }
+    };
+
+    template<class Protocol, class Wire, class Order = typename Protocol::order> struct encoder {
+        using protocol = Protocol;
+        using word = typename Wire::word;
+
+        static constexpr size_t bitsPerComponent = Protocol::bitsPerComponent;
+        static constexpr size_t bitsPerLed = bitsPerComponent * Order::componentsN;
+        static constexpr size_t wordsPerLed = ( bitsPerLed / 8 ) * Wire::wordsPerByte;
+        static constexpr size_t bytesPerLed = wordsPerLed * sizeof(word);
+
+        static_assert(bitsPerComponent % 8 == 0 && bitsPerComponent <= 16);
+
+        static word *encode(word *p, const color::rgba<uint16_t> &pixel) {
+            Order::each(Protocol::fix(pixel), [&p](uint16_t v) {
+                // Components are 16-bit, narrower protocols take the top bits
+                v >>= 16 - bitsPerComponent;
+                if constexpr (bitsPerComponent == 16) {
+                    p = Wire::expand(p, uint8_t(v >> 8));
+                }
+                p = Wire::expand(p, uint8_t(v));
+            });
+            return p;
+        }
+    };
+
+}
+
+#endif /* ONEWIRE_H_ */
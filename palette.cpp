@@ -0,0 +1,135 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./palette.h"
+
+#include <algorithm>
+
+Palettes &Palettes::instance() {
+    static Palettes palettes;
+    return palettes;
+}
+
+const color::gradient &Palettes::get(std::span<const stop> stops) {
+    useCount++;
+
+    if (stops.empty()) {
+        static constexpr stop black { 0x000000, 0.0f };
+        stops = std::span<const stop>(&black, 1);
+    }
+    size_t count = std::min(stops.size(), stopsMax);
+    stops = stops.first(count);
+
+    entry *oldest = &cache[0];
+    for (entry &e : cache) {
+        if (e.key.count == count && std::equal(stops.begin(), stops.end(), e.key.stops.begin())) {
+            e.lastUse = useCount;
+            return e.gradient;
+        }
+        if (e.lastUse < oldest->lastUse) {
+            oldest = &e;
+        }
+    }
+
+    std::array<vector::float4, stopsMax> luv;
+    for (size_t c = 0; c < count; c++) {
+        luv[c] = color::srgb(vector::float4(float((stops[c].rgb >> 16) & 0xFF) * ( 1.0f / 255.0f ),
+                                            float((stops[c].rgb >>  8) & 0xFF) * ( 1.0f / 255.0f ),
+                                            float((stops[c].rgb >>  0) & 0xFF) * ( 1.0f / 255.0f )), stops[c].pos);
+    }
+    // A single stop is a solid color
+    if (count == 1) {
+        luv[1] = vector::float4(luv[0].x, luv[0].y, luv[0].z, 1.0f);
+        luv[0].w = 0.0f;
+    }
+
+    std::copy(stops.begin(), stops.end(), oldest->key.stops.begin());
+    oldest->key.count = count;
+    oldest->lastUse = useCount;
+    oldest->gradient.build(luv.data(), std::max(count, size_t(2)));
+    return oldest->gradient;
+}
+
+const color::gradient *Palettes::file(size_t index) {
+    if (index >= filePalettesCount) {
+        return nullptr;
+    }
+    return &get(filePalettes[index].span());
+}
+
+bool Palettes::parseLine(const char *line, size_t len) {
+    if (filePalettesCount >= filePalettesN) {
+        return false;
+    }
+
+    auto hex = [](char c) -> int32_t {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    stops_list list;
+    int32_t lastPos = -1;
+    size_t i = 0;
+    for (;;) {
+        while (i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) {
+            i++;
+        }
+        if (i >= len || line[i] == '#') {
+            break;
+        }
+        if (list.count >= stopsMax) {
+            return false;
+        }
+
+        uint32_t rgb = 0;
+        size_t digits = 0;
+        for (; i < len && hex(line[i]) >= 0; i++, digits++) {
+            rgb = ( rgb << 4 ) | uint32_t(hex(line[i]));
+        }
+        if (digits != 6 || i >= len || line[i] != '@') {
+            return false;
+        }
+        i++;
+
+        uint32_t pos = 0;
+        digits = 0;
+        for (; i < len && line[i] >= '0' && line[i] <= '9'; i++, digits++) {
+            pos = pos * 10 + uint32_t(line[i] - '0');
+        }
+        // Positions start at 0, strictly increase and end at 255
+        if (digits == 0 || digits > 3 || pos > 255 || int32_t(pos) <= lastPos || ( lastPos < 0 && pos != 0 )) {
+            return false;
+        }
+        lastPos = int32_t(pos);
+
+        list.stops[list.count++] = { rgb, float(pos) * ( 1.0f / 255.0f ) };
+    }
+
+    if (list.count < 2 || lastPos != 255) {
+        return false;
+    }
+
+    filePalettes[filePalettesCount++] = list;
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include "./color.h"
+
+#include <stdint.h>
+#include <array>
+#include <span>
+
+// Gradients which are only known at runtime, like ones built from model colors or loaded from
+// the SD card. Built tables are cached by their stop list, so a lookup with unchanged stops is a
+// compare and no rebuild.
+class Palettes {
+public:
+    static Palettes &instance();
+
+    struct stop {
+        uint32_t rgb;   // sRGB, 0xRRGGBB
+        float pos;      // 0 to 1
+
+        bool operator==(const stop &) const = default;
+    };
+
+    static constexpr size_t stopsMax = 8;
+    // One runtime gradient per effect and at most two effects per frame while crossfading
+    static constexpr size_t cacheN = 2;
+    static constexpr size_t filePalettesN = 8;
+
+    // Gradient for up to stopsMax stops, rebuilt only if the stops are not in the cache
+    const color::gradient &get(std::span<const stop> stops);
+
+    // Palettes loaded from the SD card, nullptr if index is out of range
+    size_t fileCount() const { return filePalettesCount; }
+    const color::gradient *file(size_t index);
+
+    // One palette per line, stops as RRGGBB@pos with pos from 0 to 255, separated by spaces.
+    // Positions have to start at 0, strictly increase and end at 255, other lines are rejected.
+    // Lines starting with # are ignored.
+    //
+    // ff0000@0 00ff00@128 0000ff@255
+    //
+    bool parseLine(const char *line, size_t len);
+
+private:
+    struct stops_list {
+        std::array<stop, stopsMax> stops;
+        size_t count = 0;
+
+        std::span<const stop> span() const { return std::span<const stop>(stops.data(), count); }
+    };
+
+    struct entry {
+        stops_list key;
+        uint32_t lastUse = 0;
+        color::gradient gradient;
+    };
+
+    std::array<entry, cacheN> cache;
+    uint32_t useCount = 0;
+
+    std::array<stops_list, filePalettesN> filePalettes;
+    size_t filePalettesCount = 0;
+};
+
+#endif /* PALETTE_H_ */
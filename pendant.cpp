@@ -25,6 +25,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./leds.h"
 #include "./i2cmanager.h"
 #include "./timeline.h"
+#include "./frame.h"
 #include "./sdcard.h"
 #include "./input.h"
 #include "./stm32wl.h"
@@ -34,6 +35,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./model.h"
 #include "./seed.h"
 #include "./msc.h"
+#include "./profiler.h"
 
 #include "M480.h"
 
@@ -49,6 +51,7 @@ Pendant &Pendant::instance() {
 }
 
 void Pendant::init() {
+    Profiler::init();
     Seed::instance(); 
     Model::instance();
     Timeline::instance();
@@ -66,8 +69,21 @@ void Pendant::init() {
 
 void Pendant::Run() {
     Model::instance().IncBootCount();
+    FrameClock effectClock;
+    FrameClock displayClock;
     while (1) {
+#ifdef USE_TICKLESS
+        // Masked until we are asleep, an interrupt arriving in between still wakes us right away.
+        // USB needs the clocks running while attached.
+        __disable_irq();
+        if (USBD_IS_ATTACHED() ||
+            !Timeline::instance().SleepUntil(Timeline::instance().NextDeadline(SDD1306::instance().IsDisplayOn()))) {
+            __WFI();
+        }
+        __enable_irq();
+#else  // #ifdef USE_TICKLESS
         __WFI();
+#endif  // #ifdef USE_TICKLESS
         SDCard::instance().process();
         if (Timeline::instance().CheckIdleReadyAndClear()) {
             I2CManager::instance().reprobeCritial();
@@ -80,7 +96,7 @@ void Pendant::Run() {
             Timeline::instance().ProcessInterval();
             Timeline::instance().ProcessEffect();
             if (Timeline::instance().TopEffect().Valid()) {
-                Timeline::instance().TopEffect().Calc();
+                Timeline::instance().TopEffect().Calc(effectClock.capture());
                 Timeline::instance().TopEffect().Commit();
             }
         }
@@ -89,7 +105,7 @@ void Pendant::Run() {
             Timeline::instance().ProcessInterval();
             Timeline::instance().ProcessDisplay();
             if (Timeline::instance().TopDisplay().Valid()) {
-                Timeline::instance().TopDisplay().Calc();
+                Timeline::instance().TopDisplay().Calc(displayClock.capture());
                 Timeline::instance().TopDisplay().Commit();
             }
         }
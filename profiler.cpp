@@ -0,0 +1,91 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "./profiler.h"
+
+#include <stdio.h>
+
+void Profiler::init() {
+#if defined(__arm__)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif  // #if defined(__arm__)
+}
+
+#ifdef USE_PROFILER
+
+std::array<Profiler::Stats, Profiler::ZonesN> Profiler::zones;
+
+void Profiler::record(Zone zone, uint32_t ticks) {
+    Stats &s = zones[zone];
+    s.count++;
+    s.total += ticks;
+    if (ticks < s.min) s.min = ticks;
+    if (ticks > s.max) s.max = ticks;
+    uint32_t bits = 32 - uint32_t(__builtin_clz(ticks | 1));
+    uint32_t bucket = bits > minBucketBits ? bits - minBucketBits : 0;
+    s.histogram[bucket < bucketsN ? bucket : bucketsN - 1]++;
+}
+
+const char *Profiler::name(Zone zone) {
+    switch (zone) {
+        case EffectCalc:
+            return "Effects";
+        case LedPrepare:
+            return "Prepare";
+        case BirdIRQ:
+            return "BirdIRQ";
+        case SDCardProcess:
+            return "SDCard";
+        case OLEDDisplay:
+            return "OLED";
+        case STM32WLUpdate:
+            return "STM32WL";
+        case ZonesN:
+        break;
+    }
+    return "?";
+}
+
+void Profiler::reset() {
+    zones.fill(Stats());
+}
+
+void Profiler::dump() {
+    printf("zone         count      min us      avg us      max us\n");
+    for (size_t z = 0; z < ZonesN; z++) {
+        const Stats &s = zones[z];
+        if (!s.count) {
+            continue;
+        }
+        printf("%-8s %9u %11.1f %11.1f %11.1f\n", name(Zone(z)), (unsigned)s.count,
+            double(toMicroseconds(s.min)), double(toMicroseconds(s.avg())), double(toMicroseconds(s.max)));
+        printf("        ");
+        for (size_t b = 0; b < bucketsN; b++) {
+            printf(" %u", (unsigned)s.histogram[b]);
+        }
+        printf("\n");
+    }
+}
+
+#endif  // #ifdef USE_PROFILER
@@ -0,0 +1,123 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+//#define USE_PROFILER 1
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__arm__)
+#include "M480.h"
+#else  // #if defined(__arm__)
+#include <chrono>
+#endif  // #if defined(__arm__)
+
+// Cycle profiler. now() reads the DWT cycle counter on the target and nanoseconds from
+// std::chrono on a host. With USE_PROFILER defined, Profiler::Scope records the time spent
+// in a zone; without it scopes compile to nothing.
+class Profiler {
+public:
+    enum Zone {
+        EffectCalc,
+        LedPrepare,
+        BirdIRQ,
+        SDCardProcess,
+        OLEDDisplay,
+        STM32WLUpdate,
+        ZonesN
+    };
+
+    // Histogram buckets are powers of two, the first one holds everything up to 2^minBucketBits
+    static constexpr size_t bucketsN = 16;
+    static constexpr uint32_t minBucketBits = 6;
+
+    struct Stats {
+        uint32_t count = 0;
+        uint64_t total = 0;
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+        std::array<uint32_t, bucketsN> histogram {};
+
+        uint32_t avg() const { return count ? uint32_t(total / count) : 0; }
+    };
+
+    static void init();
+
+    static uint32_t now() {
+#if defined(__arm__)
+        return DWT->CYCCNT;
+#else  // #if defined(__arm__)
+        return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif  // #if defined(__arm__)
+    }
+
+    // Ticks per second of now()
+    static uint32_t frequency() {
+#if defined(__arm__)
+        return SystemCoreClock;
+#else  // #if defined(__arm__)
+        return 1000000000;
+#endif  // #if defined(__arm__)
+    }
+
+    static float toMicroseconds(uint32_t ticks) {
+        return float(ticks) * ( 1000000.0f / float(frequency()) );
+    }
+
+#ifdef USE_PROFILER
+    class Scope {
+    public:
+        explicit Scope(Zone _zone) : zone(_zone), start(now()) { }
+        ~Scope() { record(zone, now() - start); }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Zone zone;
+        uint32_t start;
+    };
+
+    static void record(Zone zone, uint32_t ticks);
+    static const Stats &stats(Zone zone) { return zones[zone]; }
+    static const char *name(Zone zone);
+
+    static void reset();
+
+    // Print all zones on stdout, which goes to the UART
+    static void dump();
+
+private:
+    static std::array<Stats, ZonesN> zones;
+#else  // #ifdef USE_PROFILER
+    class Scope {
+    public:
+        explicit Scope(Zone) { }
+    };
+#endif  // #ifdef USE_PROFILER
+};
+
+#endif /* PROFILER_H_ */
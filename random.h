@@ -0,0 +1,133 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include "./seed.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared pseudo random numbers. Every consumer owns a 16 byte Stream, derived from all 128 bits
+// of the boot seed and the consumer id, so streams do not depend on each other or on init order.
+class Random {
+public:
+    enum Consumer {
+        TimelineFuzz,
+        EffectRandom,
+        RGBBandWalk
+    };
+
+    // Bob Jenkins' small fast generator
+    class Stream {
+    public:
+        Stream() {
+            seed(0);
+        }
+
+        explicit Stream(uint32_t s) {
+            seed(s);
+        }
+
+        Stream(uint32_t sb, uint32_t sc, uint32_t sd) {
+            seed(sb, sc, sd);
+        }
+
+        void seed(uint32_t s) {
+            seed(s, s, s);
+        }
+
+        // The three seeded words, a stays fixed so no seed can hit the all zero state
+        void seed(uint32_t sb, uint32_t sc, uint32_t sd) {
+            a = 0xf1ea5eed, b = sb, c = sc, d = sd;
+            for (uint32_t i = 0; i < 20; ++i) {
+                (void)get();
+            }
+        }
+
+        uint32_t get() {
+            uint32_t e = a - rot(b, 27);
+            a = b ^ rot(c, 17);
+            b = c + d;
+            c = d + e;
+            d = e + a;
+            return d;
+        }
+
+        // [0, 1) with 24 bits of resolution
+        float unit() {
+            return float(get() >> 8) * ( 1.0f / float(1UL << 24) );
+        }
+
+        // [lower, upper)
+        float get(float lower, float upper) {
+            return unit() * (upper - lower) + lower;
+        }
+
+        // [lower, upper), without the modulo bias
+        int32_t get(int32_t lower, int32_t upper) {
+            return lower + int32_t(( uint64_t(get()) * uint64_t(uint32_t(upper - lower)) ) >> 32);
+        }
+
+    private:
+        static constexpr uint32_t rot(uint32_t x, uint32_t k) {
+            return ( x << k ) | ( x >> ( 32 - k ) );
+        }
+
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+        uint32_t d;
+    };
+
+    static Stream stream(Consumer consumer) {
+        return stream(Seed::instance().words(), consumer);
+    }
+
+    // Every seed word reaches every stream word, so no part of the seed is shared as is
+    static Stream stream(const Seed::words_t &seed, Consumer consumer) {
+        uint32_t h = uint32_t(consumer + 1) * 0x9E3779B9UL;
+        for (uint32_t word : seed) {
+            h = mix(h ^ word);
+        }
+        uint32_t s[3];
+        for (size_t c = 0; c < 3; c++) {
+            h = mix(h ^ seed[c]);
+            s[c] = h;
+        }
+        return Stream(s[0], s[1], s[2]);
+    }
+
+private:
+    // MurmurHash3 finalizer
+    static constexpr uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85EBCA6BUL;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35UL;
+        h ^= h >> 16;
+        return h;
+    }
+};
+
+#endif /* RANDOM_H_ */
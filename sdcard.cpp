@@ -26,6 +26,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./stm32wl.h"
 #include "./timeline.h"
 #include "./version.h"
+#include "./profiler.h"
+#include "./palette.h"
 
 #include "M480.h"
 #include "diskio.h"
@@ -148,6 +150,7 @@ SDCard& SDCard::instance() {
 }
 
 void SDCard::process() {
+    Profiler::Scope profile(Profiler::SDCardProcess);
 
     if (((SYS->CSERVER & SYS_CSERVER_VERSION_Msk) == 0x1)) {
         /* Start USB trim if it is not enabled. */
@@ -206,11 +209,11 @@ void SDCard::writeBlock(uint32_t blockAddr, const uint8_t* buffer, int32_t block
 }
 
 bool SDCard::readBytes(uint8_t* buf, size_t len) {
-    uint64_t start_time = Timeline::FastSystemTime();
-    uint64_t max_timout = Timeline::FastSystemTimeCmp() * 10;
+    uint64_t start_time = Timeline::Now();
+    uint64_t max_timout = Timeline::ticksPerSecond * 10;
     for (; QSPIReadByte() != 0xFE;) {
-        if ((Timeline::FastSystemTime() - start_time) > max_timout) {
-            printf("SDCard::readBytes: timeout %d len %d!\n", int((Timeline::FastSystemTime() - start_time)), int(len));
+        if ((Timeline::Now() - start_time) > max_timout) {
+            printf("SDCard::readBytes: timeout %d len %d!\n", int((Timeline::Now() - start_time)), int(len));
             return false;
         }
     }
@@ -244,11 +247,11 @@ void SDCard::QSPIWriteByte(uint8_t byte) {
 }
 
 bool SDCard::waitReady() {
-    uint64_t start_time = Timeline::FastSystemTime();
-    uint64_t max_timout = Timeline::FastSystemTimeCmp() * 10;
+    uint64_t start_time = Timeline::Now();
+    uint64_t max_timout = Timeline::ticksPerSecond * 10;
     for (; QSPIReadByte() != 0xFF;) {
-        if ((Timeline::FastSystemTime() - start_time) > max_timout) {
-            printf("SDCard::waitReady: timeout %d!\n", int((Timeline::FastSystemTime() - start_time)));
+        if ((Timeline::Now() - start_time) > max_timout) {
+            printf("SDCard::waitReady: timeout %d!\n", int((Timeline::Now() - start_time)));
             return false;
         }
     }
@@ -444,11 +447,11 @@ bool SDCard::goIdle() {
         }
     }
 
-    uint64_t start_time = Timeline::FastSystemTime();
-    uint64_t max_timout = Timeline::FastSystemTimeCmp() * 10;
+    uint64_t start_time = Timeline::Now();
+    uint64_t max_timout = Timeline::ticksPerSecond * 10;
     for (; std::get<1>(SendCmd(CMD0, 0)) != 1;) {
-        if ((Timeline::FastSystemTime() - start_time) > max_timout) {
-            printf("SDCard::goIdle: timeout %d!\n", int((Timeline::FastSystemTime() - start_time)));
+        if ((Timeline::Now() - start_time) > max_timout) {
+            printf("SDCard::goIdle: timeout %d!\n", int((Timeline::Now() - start_time)));
             return false;
         }
     }
@@ -475,11 +478,11 @@ bool SDCard::detectCardType() {
             printf("SDCard: MMC Card detected! (Unsupported)\n");
         }
         if (SDv2) {
-            uint64_t start_time = Timeline::FastSystemTime();
-            uint64_t max_timout = Timeline::FastSystemTimeCmp() * 10;
+            uint64_t start_time = Timeline::Now();
+            uint64_t max_timout = Timeline::ticksPerSecond * 10;
             for (; std::get<1>(SendCmd(ACMD41, 0x40000000)) != 0;) {
-                if ((Timeline::FastSystemTime() - start_time) > max_timout) {
-                    printf("SDCard::detectCardType: timeout %d!\n", int((Timeline::FastSystemTime() - start_time)));
+                if ((Timeline::Now() - start_time) > max_timout) {
+                    printf("SDCard::detectCardType: timeout %d!\n", int((Timeline::Now() - start_time)));
                     return false;
                 }
             }
@@ -545,6 +548,52 @@ void SDCard::findDataFile() {
     }
 }
 
+void SDCard::findPalettes() {
+    if (!mounted) {
+        return;
+    }
+
+    FIL Fil;
+    if (f_open(&Fil, "palettes.txt", FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+        return;
+    }
+
+    printf("SDCard: Found palettes.txt!\n");
+
+    // Line by line, the stack is small
+    BYTE buffer[64];
+    char line[128];
+    size_t lineLen = 0;
+    bool overlong = false;
+    for (;;) {
+        UINT readLen = sizeof(buffer);
+        f_read(&Fil, buffer, readLen, &readLen);
+        for (UINT c = 0; c < readLen; c++) {
+            if (buffer[c] == '\n') {
+                if (!overlong && lineLen) {
+                    Palettes::instance().parseLine(line, lineLen);
+                }
+                lineLen = 0;
+                overlong = false;
+            } else if (lineLen < sizeof(line)) {
+                line[lineLen++] = char(buffer[c]);
+            } else {
+                overlong = true;
+            }
+        }
+        if (readLen < sizeof(buffer)) {
+            break;
+        }
+    }
+    if (!overlong && lineLen) {
+        Palettes::instance().parseLine(line, lineLen);
+    }
+
+    printf("SDCard: %d palettes\n", int(Palettes::instance().fileCount()));
+
+    f_close(&Fil);
+}
+
 void SDCard::findFirmware() {
     if (!mounted) {
         return;
@@ -638,6 +687,7 @@ void SDCard::init() {
         findFirmware();
 #ifndef BOOTLOADER
         findDataFile();
+        findPalettes();
 #endif // #ifndef BOOTLOADER
     }
 
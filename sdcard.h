@@ -208,6 +208,7 @@ private:
 
     void findFirmware();
     void findDataFile();
+    void findPalettes();
 
     friend DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff);
     friend DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count );
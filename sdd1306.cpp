@@ -24,6 +24,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./main.h"
 #include "./i2cmanager.h"
 #include "./timeline.h"
+#include "./profiler.h"
 
 #include "M480.h"
 
@@ -165,8 +166,9 @@ void SDD1306::SetBootScreen(bool on, int32_t xpos) {
     boot_screen_offset = xpos;
 }
     
-void SDD1306::Display() {
-    if (!devicePresent) return;
+bool SDD1306::Display() {
+    Profiler::Scope profile(Profiler::OLEDDisplay);
+    if (!devicePresent) return false;
 
     I2CManager::instance().prepareBatchWrite();
 
@@ -176,6 +178,7 @@ void SDD1306::Display() {
         display_center_flip = true;
     }
 
+    bool changed = display_center_flip || display_boot_screen;
     if (display_boot_screen) {
         DisplayBootScreen();
     } else {
@@ -185,6 +188,7 @@ void SDD1306::Display() {
                     text_attr_cache[y*text_x_size+x] != text_attr_screen[y*text_x_size+x]) {
                     text_buffer_screen[y*text_x_size+x] = text_buffer_cache[y*text_x_size+x];
                     text_attr_screen[y*text_x_size+x] = text_attr_cache[y*text_x_size+x];
+                    changed = true;
                     if (!display_center_flip) {
                         DisplayChar(x,y,text_buffer_screen[y*text_x_size+x],text_attr_screen[y*text_x_size+x]);
                     }
@@ -197,6 +201,7 @@ void SDD1306::Display() {
     }
 
     I2CManager::instance().performBatchWrite();
+    return changed;
 }
     
 void SDD1306::SetVerticalShift(int8_t val) {
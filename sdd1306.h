@@ -41,7 +41,8 @@ public:
     void SetAttr(uint32_t x, uint32_t y, uint8_t attr);
     void SetAsciiScrollMessage(const char *str, int32_t offset);
 
-    void Display();
+    // Returns whether anything on the screen changed
+    bool Display();
 
     void Invert();
 
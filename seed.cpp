@@ -26,6 +26,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "M480.h"
 #include "trng.h"
 
+#include <stdio.h>
+
 Seed &Seed::instance() {
     static Seed seed;
     if (!seed.initialized) {
@@ -36,6 +38,19 @@ Seed &Seed::instance() {
 }
 
 void Seed::init() {
-    // Get seed from STM32WL
+    // TRNG clock is enabled in SYS_Init, PCLK is 96Mhz
+    if (TRNG_Open() == 0) {
+        TRNG_SET_CLKP(0);
+        // About 1ms per byte
+        if (TRNG_GenBignum(data.data(), int32_t(data.size() * 8)) == 0) {
+            TRNG->ACT &= ~TRNG_ACT_ACT_Msk;
+            return;
+        }
+        TRNG->ACT &= ~TRNG_ACT_ACT_Msk;
+    }
+    printf("Seed: TRNG failed, using a fixed seed!\n");
+    for (size_t c = 0; c < data.size(); c++) {
+        data[c] = uint8_t(c * 73 + 41);
+    }
 }
 
@@ -24,23 +24,32 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define SEED_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <array>
 
 class Seed {
 public:
     static Seed &instance();
 
-    uint32_t seedU32() const { return 
-        (uint32_t(data[0]) << 24) |
-        (uint32_t(data[1]) << 16) |
-        (uint32_t(data[2]) <<  8) |
-        (uint32_t(data[3]) <<  0); }
+    using words_t = std::array<uint32_t, 4>;
+
+    // All 16 TRNG bytes as big endian words
+    words_t words() const {
+        words_t w;
+        for (size_t c = 0; c < w.size(); c++) {
+            w[c] = (uint32_t(data[c * 4 + 0]) << 24) |
+                   (uint32_t(data[c * 4 + 1]) << 16) |
+                   (uint32_t(data[c * 4 + 2]) <<  8) |
+                   (uint32_t(data[c * 4 + 3]) <<  0);
+        }
+        return w;
+    }
 
 private:
     bool initialized = false;
     void init();
 
-    std::array<uint8_t, 256> data;
+    std::array<uint8_t, 16> data;
 };
 
 #endif /* SEED_H_ */
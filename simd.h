@@ -0,0 +1,125 @@
+/*
+Copyright 2021 Tinic Uro
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include "./color.h"
+
+#include <cstdint>
+
+#if defined(__arm__)
+#include "M480.h"
+#endif  // #if defined(__arm__)
+
+// Packed halfword helpers. simd::reference is plain C++ and always available,
+// simd::dsp maps the same operations onto the Cortex-M4 DSP instructions. Kernels
+// take the implementation as a template argument and default to simd::native, so a
+// host build can check them against the reference.
+namespace simd {
+
+    struct reference {
+        static constexpr uint32_t pack16(int16_t lo, int16_t hi) {
+            return uint32_t(uint16_t(lo)) | ( uint32_t(uint16_t(hi)) << 16 );
+        }
+
+        static constexpr int16_t sat16(int32_t v) {
+            return int16_t(v < INT16_MIN ? INT16_MIN : ( v > INT16_MAX ? INT16_MAX : v ));
+        }
+
+        static constexpr uint32_t qadd16(uint32_t a, uint32_t b) {
+            return pack16(sat16(int32_t(lo16(a)) + lo16(b)), sat16(int32_t(hi16(a)) + hi16(b)));
+        }
+
+        static constexpr int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+            return acc + int32_t(lo16(a)) * lo16(b) + int32_t(hi16(a)) * hi16(b);
+        }
+
+        static constexpr int16_t lo16(uint32_t v) { return int16_t(v & 0xFFFF); }
+        static constexpr int16_t hi16(uint32_t v) { return int16_t(v >> 16); }
+    };
+
+#if defined(__ARM_FEATURE_DSP)
+    struct dsp : public reference {
+        __attribute__((always_inline)) static uint32_t pack16(int16_t lo, int16_t hi) {
+            return __PKHBT(uint32_t(uint16_t(lo)), uint32_t(hi), 16);
+        }
+
+        __attribute__((always_inline)) static int16_t sat16(int32_t v) {
+            return int16_t(__SSAT(v, 16));
+        }
+
+        __attribute__((always_inline)) static uint32_t qadd16(uint32_t a, uint32_t b) {
+            return __QADD16(a, b);
+        }
+
+        __attribute__((always_inline)) static int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+            return int32_t(__SMLAD(a, b, uint32_t(acc)));
+        }
+    };
+
+    using native = dsp;
+#else  // #if defined(__ARM_FEATURE_DSP)
+    using native = reference;
+#endif  // #if defined(__ARM_FEATURE_DSP)
+
+    // q15 blend factor, 1.0 is one past the largest q15 value
+    static constexpr int32_t q15One = 32768;
+
+    static inline int32_t toQ15(float f) {
+        return int32_t(f * float(q15One));
+    }
+
+    // a + (b - a) * t with t in q15, 0 < t < q15One. Both weights fit a halfword
+    // so every component is a single multiply-accumulate pair.
+    template<class Ops = native> color::luv16 lerp(const color::luv16 &a, const color::luv16 &b, int32_t t) {
+        const uint32_t w = Ops::pack16(int16_t(q15One - t), int16_t(t));
+        color::luv16 r;
+        r.l = int16_t(Ops::smlad(Ops::pack16(a.l, b.l), w, 1 << 14) >> 15);
+        r.u = int16_t(Ops::smlad(Ops::pack16(a.u, b.u), w, 1 << 14) >> 15);
+        r.v = int16_t(Ops::smlad(Ops::pack16(a.v, b.v), w, 1 << 14) >> 15);
+        return r;
+    }
+
+    // Saturating a + b
+    template<class Ops = native> color::luv16 add(const color::luv16 &a, const color::luv16 &b) {
+        const uint32_t lu = Ops::qadd16(Ops::pack16(a.l, a.u), Ops::pack16(b.l, b.u));
+        color::luv16 r;
+        r.l = reference::lo16(lu);
+        r.u = reference::hi16(lu);
+        r.v = Ops::sat16(int32_t(a.v) + b.v);
+        return r;
+    }
+
+    // a scaled by the lightness of b
+    template<class Ops = native> color::luv16 multiply(const color::luv16 &a, const color::luv16 &b) {
+        constexpr int32_t shift = color::luv16::fractionBits;
+        color::luv16 r;
+        r.l = Ops::sat16(( int32_t(a.l) * b.l ) >> shift);
+        r.u = Ops::sat16(( int32_t(a.u) * b.l ) >> shift);
+        r.v = Ops::sat16(( int32_t(a.v) * b.l ) >> shift);
+        return r;
+    }
+
+}
+
+#endif /* SIMD_H_ */
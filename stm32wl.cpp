@@ -23,6 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "./stm32wl.h"
 #include "./model.h"
 #include "./timeline.h"
+#include "./profiler.h"
 
 #include "M480.h"
 
@@ -43,6 +44,7 @@ STM32WL &STM32WL::instance() {
 }
 
 void STM32WL::update() {
+    Profiler::Scope profile(Profiler::STM32WLUpdate);
     if (!devicePresent) return;
 
     // Get zero register so peripheral will update fields
@@ -64,7 +66,7 @@ void STM32WL::update() {
 
     set8u(offsetof(I2CRegs,fields.effectN),i2cRegs.fields.effectN = Model::instance().Effect());
     set8u(offsetof(I2CRegs,fields.brightness),i2cRegs.fields.brightness = uint8_t(Model::instance().Brightness() * 255.0f));
-    set16u(offsetof(I2CRegs,fields.systemTime), i2cRegs.fields.systemTime = uint16_t(Timeline::SystemTime()));
+    set16u(offsetof(I2CRegs,fields.systemTime), i2cRegs.fields.systemTime = uint16_t(Timeline::Now() / Timeline::ticksPerSecond));
 
     Model::instance().RingColor().write_rgba_bytes(&i2cRegs.fields.ring_color[0]);
     Model::instance().BirdColor().write_rgba_bytes(&i2cRegs.fields.bird_color[0]);
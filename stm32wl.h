@@ -41,6 +41,8 @@ public:
     uint16_t SystemTime() const { return i2cRegs.fields.systemTime; }
     uint32_t DateTime() const { return i2cRegs.fields.rtcDateTime; }
 
+    bool DevicePresent() const { return devicePresent; }
+
 private:
     friend class I2CManager;
     static constexpr uint8_t i2c_addr = 0x33;
@@ -22,17 +22,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./timeline.h"
 #include "./model.h"
-#include "./seed.h"
 
+#if defined(__arm__)
 #include "M480.h"
+#endif  // #if defined(__arm__)
 
 #include <limits>
 #include <array>
 #include <algorithm>
 
+#if defined(__arm__)
 extern "C" {
 
-static uint32_t systemSeconds = 0;
+static volatile uint32_t systemSeconds = 0;
 
 void TMR0_IRQHandler(void)
 {
@@ -53,6 +55,17 @@ void TMR1_IRQHandler(void)
 }
 
 }
+#else  // #if defined(__arm__)
+// Simulated clock for host builds
+static Timeline::ticks hostTicks = 0;
+
+static bool effectReady = false;
+
+void Timeline::SetHostTime(ticks now) {
+    hostTicks = now;
+    effectReady = true;
+}
+#endif  // #if defined(__arm__)
 
 float Quad::easeIn (float t,float b , float c, float d) {
     t /= d;
@@ -103,180 +116,200 @@ Timeline &Timeline::instance() {
 }
 
 bool Timeline::Scheduled(Timeline::Span &span) {
-    for (Span *i = head; i ; i = i->next) {
-        if ( i == &span ) {
-            return true;
-        }
+    return span.queued;
+}
+
+void Timeline::link(Span *&head, Span &span, Span *after) {
+    span.prev = after;
+    span.next = after ? after->next : head;
+    if (span.next) {
+        span.next->prev = &span;
+    }
+    if (after) {
+        after->next = &span;
+    } else {
+        head = &span;
     }
-    return false;
 }
 
-void Timeline::Add(Timeline::Span &span) {
-    for (Span *i = head; i ; i = i->next) {
-        if ( i == &span ) {
-            return;
-        }
+void Timeline::unlink(Span *&head, Span &span) {
+    if (span.prev) {
+        span.prev->next = span.next;
+    } else {
+        head = span.next;
+    }
+    if (span.next) {
+        span.next->prev = span.prev;
+    }
+    span.next = 0;
+    span.prev = 0;
+}
+
+void Timeline::schedule(Queue &q, Span &span) {
+    // By start time, after spans with the same start
+    Span *after = 0;
+    for (Span *i = q.pending; i && i->time <= span.time; i = i->next) {
+        after = i;
+    }
+    span.active = false;
+    link(q.pending, span, after);
+}
+
+void Timeline::run(Queue &q, Span &span) {
+    // By priority, then latest start first. Ahead of spans with the same priority and start.
+    Span *after = 0;
+    for (Span *i = q.running; i && (i->priority > span.priority ||
+                                   (i->priority == span.priority && i->time > span.time)); i = i->next) {
+        after = i;
     }
+    span.active = true;
+    link(q.running, span, after);
+    if (span.duration != forever) {
+        q.nextEnd = std::min(q.nextEnd, span.time + span.duration);
+    }
+}
 
-    span.next = head;
-    head = &span;
+void Timeline::Add(Timeline::Span &span) {
+    if (span.queued || !span.Valid()) {
+        return;
+    }
+    span.queued = true;
+    schedule(queue(span.type), span);
 }
 
 void Timeline::Remove(Timeline::Span &span) {
-    Span *p = 0;
-    for (Span *i = head; i ; i = i->next) {
-        if ( i == &span ) {
-            if (p) {
-                p->next = i->next;
-            } else {
-                head = i->next;
-            }
-            i->next = 0;
-            i->Done();
-            return;
-        }
-        p = i;
+    if (!span.queued) {
+        return;
     }
+    Queue &q = queue(span.type);
+    unlink(span.active ? q.running : q.pending, span);
+    span.queued = false;
+    span.active = false;
+    span.Done();
 }
 
 void Timeline::Process(Span::Type type) {
-    static std::array<Span *, 64> collected;
-    size_t collected_num = 0;
-    double now = SystemTime();
-    Span *p = 0;
-    for (Span *i = head; i ; i = i->next) {
-        if (i->type == type) {
-            if ((i->time) <= now && !i->active) {
-                i->active = true;
-                i->Start();
-            }
-            switch (type) {
-                case Span::Display: {
-                    Display *display = static_cast<Display *>(i);
-                    if (display->duration != std::numeric_limits<double>::infinity() && ((display->time + display->duration) < now)) {
-                        if (p) {
-                            p->next = display->next;
-                        } else {
-                            head = display->next;
-                        }
-                        if (collected_num < collected.size()) {
-                            collected[collected_num++] = display;
-                        }
-                    }
-                } break;
-                case Span::Effect: {
-                    Effect *effect = static_cast<Effect *>(i);
-                    if (effect->duration != std::numeric_limits<double>::infinity() && ((effect->time + effect->duration) < now)) {
-                        if (p) {
-                            p->next = effect->next;
-                        } else {
-                            head = effect->next;
-                        }
-                        if (collected_num < collected.size()) {
-                            collected[collected_num++] = effect;
-                        }
-                    }
-                } break;
-                case Span::Interval: {
-                    Interval *interval = static_cast<Interval *>(i);
-                    if (interval->duration != std::numeric_limits<double>::infinity() && ((interval->time + interval->duration) < now)) {
-                        // Reschedule
-                        if (interval->intervalFuzz != 0.0) {
-                            std::uniform_real_distribution<> dis(interval->interval, interval->interval + interval->intervalFuzz);
-                            interval->time += dis(gen);
-                        } else {
-                            interval->time += interval->interval;
-                        }
-                        interval->active = false;
-                        interval->Done();
-                    }
-                } break;
-                case Span::None: {
-                } break;
+    Queue &q = queue(type);
+    ticks now = Now();
+
+    // Only walk running once something can have ended
+    if (now > q.nextEnd) {
+        expire(q, type, now);
+    }
+
+    // Spans which are due move over to running, the pending head is always the earliest. Runs
+    // after expiry so spans added by done callbacks take over in the same frame.
+    while (q.pending && q.pending->time <= now) {
+        Span &span = *q.pending;
+        unlink(q.pending, span);
+        run(q, span);
+        span.Start();
+    }
+}
+
+void Timeline::expire(Queue &q, Span::Type type, ticks now) {
+    // Collect expired spans through their next pointers, callbacks run once the queue is
+    // consistent again since they might add or remove spans.
+    Span *expired = 0;
+    q.nextEnd = forever;
+    for (Span *i = q.running; i ; ) {
+        Span *next = i->next;
+        if (i->duration != forever) {
+            ticks end = i->time + i->duration;
+            if (end < now) {
+                unlink(q.running, *i);
+                i->next = expired;
+                expired = i;
+            } else {
+                q.nextEnd = std::min(q.nextEnd, end);
             }
         }
-        p = i;
+        i = next;
     }
-    switch (type) {
-        case Span::Display:
-        case Span::Effect: {
-            for (size_t c = 0; c < collected_num; c++) {
-                collected[c]->active = false;
-                collected[c]->next = 0;
-                collected[c]->Done();
-            }
-        } break;
-        case Span::Interval: {
-        } break;
-        case Span::None: {
-        } break;
+
+    while (expired) {
+        Span &span = *expired;
+        expired = span.next;
+        span.next = 0;
+        switch (type) {
+            case Span::Display:
+            case Span::Effect: {
+                span.active = false;
+                span.queued = false;
+            } break;
+            case Span::Interval: {
+                Interval &interval = static_cast<Interval &>(span);
+                // Reschedule
+                if (interval.intervalFuzz != 0) {
+                    interval.time += interval.interval + ticks(random.get(int32_t(0), int32_t(interval.intervalFuzz)));
+                } else {
+                    interval.time += interval.interval;
+                }
+                schedule(q, interval);
+            } break;
+            case Span::None: {
+            } break;
+        }
+        span.Done();
     }
 }
 
 Timeline::Span &Timeline::Top(Span::Type type) const {
     static Timeline::Span empty;
-    double time = SystemTime();
-    for (Span *i = head; i ; i = i->next) {
-        if ((i->type == type) &&
-            (i->time <= time) &&
-            ( (i->duration == std::numeric_limits<double>::infinity()) || ((i->time + i->duration) > time) ) ) {
-            return *i;
-        }
-    }
-    return empty;
+    Span *top = queue(type).running;
+    return top ? *top : empty;
 }
 
 Timeline::Span &Timeline::Below(Span *context, Span::Type type) const {
     static Timeline::Span empty;
-    double time = SystemTime();
-    for (Span *i = head; i ; i = i->next) {
-        if (i == context) {
-            continue;
-        }
-        if ((i->type == type) &&
-            (i->time <= time) &&
-            ( (i->duration == std::numeric_limits<double>::infinity()) || ((i->time + i->duration) > time) ) ) {
-            return *i;
-        }
+    Span *below = queue(type).running;
+    if (context && context->queued && context->active) {
+        below = context->next;
+    } else if (below == context) {
+        below = below->next;
     }
-    return empty;
+    return below ? *below : empty;
+}
+
+float Timeline::Span::Remaining(ticks now) const {
+    return float(int32_t(int64_t(time + duration - now))) * ( 1.0f / float(duration) );
 }
 
 std::tuple<bool, float> Timeline::Effect::InAttackPeriod() const {
-    double now = Timeline::SystemTime();
-    if ( (now - time) < static_cast<double>(attack)) {
-        return {true, static_cast<float>((now - time) * (1.0 / static_cast<double>(attack))) };
+    ticks elapsed = Now() - time;
+    if (elapsed < attack) {
+        return {true, float(uint32_t(elapsed)) * ( 1.0f / float(attack) ) };
     }
     return {false, 0.0f};
 }
 
 std::tuple<bool, float> Timeline::Effect::InDecayPeriod() const {
-    double now = Timeline::SystemTime();
+    ticks elapsed = Now() - time;
     if (!std::get<0>(InAttackPeriod())) {
-        if ( (now - time) < static_cast<double>(attack + decay)) {
-            return {true, static_cast<float>((now - time) * (1.0 / static_cast<double>(decay))) };
+        if (elapsed < attack + decay) {
+            return {true, float(uint32_t(elapsed)) * ( 1.0f / float(decay) ) };
         }
     }
     return {false, 0.0f};
 }
 
 std::tuple<bool, float> Timeline::Effect::InSustainPeriod() const {
-    double now = Timeline::SystemTime();
+    ticks elapsed = Now() - time;
     if (!std::get<0>(InDecayPeriod())) {
-        double sustain = duration - attack - decay - release;
-        if ( (now - time) < static_cast<double>(attack + decay + sustain)) {
-            return {true, static_cast<float>((now - time) * (1.0 / static_cast<double>(sustain))) };
+        ticks sustain = duration - attack - decay - release;
+        if (elapsed < attack + decay + sustain) {
+            return {true, float(uint32_t(elapsed)) * ( 1.0f / float(sustain) ) };
         }
     }
     return {false, 0.0f};
 }
 
 std::tuple<bool, float>  Timeline::Effect::InReleasePeriod() const {
-    double now = Timeline::SystemTime();
+    ticks elapsed = Now() - time;
     if (!std::get<0>(InSustainPeriod())) {
-        double sustain = duration - attack - decay - release;
-        if ( (now - time) < static_cast<double>(attack + decay + sustain + release)) {
-            return { true, 1.0f - static_cast<float>(((time + duration) - now) * (1.0 / static_cast<double>(release))) };
+        ticks sustain = duration - attack - decay - release;
+        if (elapsed < attack + decay + sustain + release) {
+            return { true, 1.0f - float(uint32_t((time + duration) - Now())) * ( 1.0f / float(release) ) };
         }
     }
     return {false, 0.0f};
@@ -312,28 +345,48 @@ Timeline::Interval &Timeline::TopInterval() const
     return static_cast<Interval&>(Top(Span::Interval));
 }
 
-double Timeline::SystemTime() {
-    return double(systemSeconds) + (double(TIMER0->CNT) / double(TIMER0->CMP));
-}
-
-uint64_t Timeline::FastSystemTime() {
-    return (uint64_t(systemSeconds) * uint64_t(TIMER0->CMP)) + uint64_t(TIMER0->CNT);
+#if defined(__arm__)
+Timeline::ticks Timeline::Now() {
+    uint32_t seconds = 0;
+    uint32_t count = 0;
+    // Seconds and count have to come from the same second
+    do {
+        seconds = systemSeconds;
+        count = TIMER0->CNT;
+        // Count wrapped but the interrupt did not run yet, we are in an ISR or interrupts are off
+        if (TIMER_GetIntFlag(TIMER0) && count < ( ticksPerSecond / 2 )) {
+            seconds++;
+        }
+    } while (seconds != systemSeconds && !TIMER_GetIntFlag(TIMER0));
+    return ticks(seconds) * ticksPerSecond + count;
 }
-
-uint64_t Timeline::FastSystemTimeCmp() {
-    return uint64_t(TIMER0->CMP);
+#else  // #if defined(__arm__)
+Timeline::ticks Timeline::Now() {
+    return hostTicks;
 }
+#endif  // #if defined(__arm__)
 
 static bool idleReady = false;
 static bool backgroundReady = false;
 static bool displayReady = false;
 
+// On wall time rather than frame counts, frames stop while sleeping
+static Timeline::ticks idleDeadline = 0;
+static Timeline::ticks backgroundDeadline = 0;
+
 bool Timeline::CheckEffectReadyAndClear() {
     static size_t frameCount = 0;
     if (effectReady) {
         effectReady = false;
-        idleReady = (frameCount % size_t(effectRate * idleRate)) == 0;
-        backgroundReady = (frameCount % size_t(effectRate / backgroundRate)) == 0;
+        ticks now = Now();
+        if (now >= idleDeadline) {
+            idleReady = true;
+            idleDeadline = now + Ticks(idleRate);
+        }
+        if (now >= backgroundDeadline) {
+            backgroundReady = true;
+            backgroundDeadline = now + Ticks(1.0 / backgroundRate);
+        }
         displayReady = (frameCount % size_t(effectRate / displayRate)) == 0;
         frameCount ++;
         return true;
@@ -365,20 +418,96 @@ bool Timeline::CheckIdleReadyAndClear() {
     return false;
 }
 
+Timeline::ticks Timeline::NextDeadline(bool displayOn) const {
+    const Span &effect = Top(Span::Effect);
+    const Span &display = Top(Span::Display);
+    ticks next = std::min(idleDeadline, backgroundDeadline);
+    if (effect.Valid()) {
+        next = std::min(next, effect.stillUntil);
+    }
+    if (displayOn && display.Valid()) {
+        next = std::min(next, display.stillUntil);
+    }
+    for (const Queue &q : queues) {
+        if (q.pending) {
+            next = std::min(next, q.pending->time);
+        }
+        if (q.nextEnd != forever) {
+            // Spans expire once past their end
+            next = std::min(next, q.nextEnd + 1);
+        }
+    }
+    return next;
+}
+
+#if defined(__arm__)
+bool Timeline::SleepUntil(ticks deadline) {
+    ticks now = Now();
+    if (deadline < now + minSleep) {
+        return false;
+    }
+
+    // One shot on TIMER1, which counts LIRC ticks like TIMER0. Capped at maxSleep so TIMER0
+    // wraps at most once while asleep, its pending flag is all Now() has to go on.
+    TIMER1->CTL = TIMER_ONESHOT_MODE;
+    TIMER_SET_CMP_VALUE(TIMER1, uint32_t(std::min(deadline - now, maxSleep)));
+    TIMER_ResetCounter(TIMER1);
+    TIMER_ClearIntFlag(TIMER1);
+    TIMER_ClearWakeupFlag(TIMER1);
+    TIMER_EnableInt(TIMER1);
+    TIMER_EnableWakeup(TIMER1);
+    TIMER_Start(TIMER1);
+
+    // Normal power-down keeps LIRC, so TIMER0 and Now() keep running. The switches wake us
+    // through their GPIO interrupts.
+    SYS_UnlockReg();
+    CLK_SetPowerDownMode(CLK_PMUCTL_PDMSEL_PD);
+    CLK_PowerDown();
+    // CLK_PowerDown() leaves SLEEPDEEP set, the __WFI() in the main loop has to stay light
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+    SYS_LockReg();
+    CLK_WaitClockReady(CLK_STATUS_PLLSTB_Msk);
+
+    TIMER_DisableWakeup(TIMER1);
+    TIMER_ClearWakeupFlag(TIMER1);
+    startFrameTimer();
+
+    // Whatever woke us, run one frame to catch up
+    effectReady = true;
+    return true;
+}
+
+void Timeline::startFrameTimer() {
+    TIMER_Open(TIMER1, TIMER_PERIODIC_MODE, int32_t(effectRate));
+    TIMER_EnableInt(TIMER1);
+    TIMER_Start(TIMER1);
+}
+#else  // #if defined(__arm__)
+bool Timeline::SleepUntil(ticks) {
+    return false;
+}
+
+void Timeline::startFrameTimer() {
+}
+#endif  // #if defined(__arm__)
+
 void Timeline::init() {
-    // SystemTime timer
+#if defined(__arm__)
+    // System time, see Now()
     TIMER_Open(TIMER0, TIMER_PERIODIC_MODE, 1);
+    // Pin the tick rate, Now() relies on it
+    TIMER_SET_PRESCALE_VALUE(TIMER0, 0);
+    TIMER_SET_CMP_VALUE(TIMER0, ticksPerSecond);
     TIMER_EnableInt(TIMER0);
     NVIC_SetPriority(TMR0_IRQn, 1);
     NVIC_EnableIRQ(TMR0_IRQn);
     TIMER_Start(TIMER0);
 
     // Effect Frame rate timer
-    TIMER_Open(TIMER1, TIMER_PERIODIC_MODE, int32_t(effectRate));
-    TIMER_EnableInt(TIMER1);
     NVIC_SetPriority(TMR1_IRQn, 2);
     NVIC_EnableIRQ(TMR1_IRQn);
-    TIMER_Start(TIMER1);
+    startFrameTimer();
+#endif  // #if defined(__arm__)
 
-    gen.seed(Seed::instance().seedU32());
+    random = Random::stream(Random::TimelineFuzz);
 }
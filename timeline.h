@@ -23,10 +23,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef TIMELINE_H_
 #define TIMELINE_H_
 
+#include "./random.h"
+#include "./function.h"
+
 #include <cstdint>
-#include <functional>
+#include <cstddef>
+#include <array>
 #include <tuple>
-#include <random>
+#include <limits>
+
+// Sleep in power-down between deadlines instead of waking at the effect rate, see Pendant::Run()
+#define USE_TICKLESS 1
+
+struct FrameContext;
 
 class Quad {
 public:
@@ -51,23 +60,46 @@ public:
 
     static constexpr double idleRate = 30.0; // once a minute
 
+    // System time in TIMER0 ticks. All scheduling is done in integer ticks, conversions from and
+    // to seconds are only for the edges.
+    using ticks = uint64_t;
+
+    static constexpr ticks ticksPerSecond = 10000; // LIRC
+    static constexpr ticks forever = std::numeric_limits<ticks>::max();
+
+    static constexpr ticks Ticks(double seconds) { return ticks(seconds * double(ticksPerSecond) + 0.5); }
+    static constexpr float Seconds(ticks t) { return float(t) * ( 1.0f / float(ticksPerSecond) ); }
+
     struct Span {
 
-        double time = 0.0;
-        double duration = 0.0;
+        ticks time = 0;
+        ticks duration = 0;
 
-        std::function<void (Span &span)> startFunc;
-        std::function<void (Span &span, Span &below)> calcFunc;
-        std::function<void (Span &span)> commitFunc;
-        std::function<void (Span &span)> doneFunc;
+        // Among running spans of one type the highest priority is on top, then the latest start
+        int32_t priority = 0;
+
+        // Set by a top span whose output does not change before then, NextDeadline() does not
+        // wait for its frames until that time. forever waits for something else to wake us.
+        ticks stillUntil = 0;
+
+        inplace_function<void (Span &span)> startFunc;
+        inplace_function<void (Span &span, const FrameContext &frame)> calcFunc;
+        inplace_function<void (Span &span)> commitFunc;
+        inplace_function<void (Span &span)> doneFunc;
 
         void Start() { if (startFunc) startFunc(*this); }
-        void Calc() { if (calcFunc) calcFunc(*this, Timeline::instance().Below(this, type)); }
+        void Calc(const FrameContext &frame) { if (calcFunc) calcFunc(*this, frame); }
         void Commit() { if (commitFunc) commitFunc(*this); }
         void Done() { if (doneFunc) doneFunc(*this); }
         
         bool Valid() const { return type != None; }
 
+        // Span of the same type underneath, looked up only when a calc asks for it
+        Span &Below() { return Timeline::instance().Below(this, type); }
+
+        // Fraction of the duration still to go at now, 1 at the start and 0 at the end
+        float Remaining(ticks now) const;
+
     protected:
 
         enum Type {
@@ -83,15 +115,17 @@ public:
 
         friend class Timeline;
         bool active = false;
+        bool queued = false;
         Span *next = 0;
+        Span *prev = 0;
     };
 
     struct Interval : public Span {
 
         Interval() : Span() { type = Type::Interval; }
 
-        double interval = 0.0;
-        double intervalFuzz = 0.0;
+        ticks interval = 0;
+        ticks intervalFuzz = 0;
 
     };
 
@@ -99,9 +133,9 @@ public:
 
         Effect() : Span() { type = Type::Effect; }
 
-        double attack = 0.0;
-        double decay = 0.0;
-        double release = 0.0;
+        ticks attack = 0;
+        ticks decay = 0;
+        ticks release = 0;
 
         std::tuple<bool, float> InAttackPeriod() const;
         std::tuple<bool, float> InDecayPeriod() const;
@@ -113,9 +147,9 @@ public:
 
         Display() : Span() { type = Type::Display; }
 
-        std::function<void (Span &span, bool down)> switch1Func;
-        std::function<void (Span &span, bool down)> switch2Func;
-        std::function<void (Span &span, bool down)> switch3Func;
+        inplace_function<void (Span &span, bool down)> switch1Func;
+        inplace_function<void (Span &span, bool down)> switch2Func;
+        inplace_function<void (Span &span, bool down)> switch3Func;
 
         void ProcessSwitch1(bool down) { if (switch1Func) switch1Func(*this, down); }
         void ProcessSwitch2(bool down) { if (switch2Func) switch2Func(*this, down); }
@@ -142,21 +176,65 @@ public:
     void ProcessInterval();
     Interval &TopInterval() const;
 
-    static double SystemTime();
-    static uint64_t FastSystemTime();
-    static uint64_t FastSystemTimeCmp();
+    // Safe to call from any context, also while the seconds interrupt is pending
+    static ticks Now();
+
+    // Earliest time anything has to run: a span starting or ending, a background or idle pass,
+    // or the next frame of the top effect, or the top display if it is on, once it is not still.
+    ticks NextDeadline(bool displayOn) const;
+
+    // Powers down until the deadline, a switch or USB. Returns false without sleeping when the
+    // deadline is too close, and always on a host. Call with interrupts masked.
+    bool SleepUntil(ticks deadline);
+
+    // A top span whose last frame left its output unchanged is looked at again after this long
+    static constexpr ticks stillRecheck = ticksPerSecond / 10;
+
+    // Shorter sleeps are not worth leaving the frame timer for
+    static constexpr ticks minSleep = 2 * ticksPerSecond / ticks(effectRate);
+    // TIMER0 does not wake us, so systemSeconds can not follow more than one wrap
+    static constexpr ticks maxSleep = ticksPerSecond - 1;
+
+    // Position of time within a repeating period, from 0 to 1
+    static float Phase(ticks time, ticks period) { return float(uint32_t(time % period)) * ( 1.0f / float(period) ); }
+
+#if !defined(__arm__)
+    // Host builds run on a simulated clock which only moves when told to
+    static void SetHostTime(ticks now);
+#endif  // #if !defined(__arm__)
 
 private:
     void Process(Span::Type type);
     Span &Top(Span::Type type) const;
     Span &Below(Span *context, Span::Type type) const;
 
-    Span *head = 0;
+    // One queue per span type. Spans wait in pending until their start time and then move to
+    // running, where the head is the top span.
+    struct Queue {
+        Span *pending = 0;
+        Span *running = 0;
+        // Nothing in running can end before this
+        ticks nextEnd = forever;
+    };
+
+    static constexpr size_t typesN = 3;
+    std::array<Queue, typesN> queues;
+
+    Queue &queue(Span::Type type) { return queues[type - Span::Effect]; }
+    const Queue &queue(Span::Type type) const { return queues[type - Span::Effect]; }
+
+    static void link(Span *&head, Span &span, Span *after);
+    static void unlink(Span *&head, Span &span);
+    void schedule(Queue &queue, Span &span);
+    void run(Queue &queue, Span &span);
+    void expire(Queue &queue, Span::Type type, ticks now);
+
+    void startFrameTimer();
 
     void init();
     bool initialized = false;
 
-    std::mt19937 gen;
+    Random::Stream random;
 };
 
 #endif /* TIMELINE_H_ */
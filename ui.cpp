@@ -22,12 +22,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "./ui.h"
 #include "./timeline.h"
+#include "./frame.h"
 #include "./sdd1306.h"
 #include "./model.h"
 #include "./stm32wl.h"
+#include "./profiler.h"
 
 #include <stdio.h>
 
+#ifdef USE_PROFILER
+// 0 is the regular screen, then one page per profiler zone
+static size_t profilerPage = 0;
+#endif  // #ifdef USE_PROFILER
+
 UI &UI::instance() {
     static UI ui;
     if (!ui.initialized) {
@@ -40,15 +47,32 @@ UI &UI::instance() {
 void UI::init() {
     static Timeline::Display mainUI;
     if (!Timeline::instance().Scheduled(mainUI)) {
-        mainUI.time = Timeline::SystemTime();
-        mainUI.duration = std::numeric_limits<double>::infinity();
+        mainUI.time = Timeline::Now();
+        mainUI.duration = Timeline::forever;
 
-        mainUI.calcFunc = [=](Timeline::Span &, Timeline::Span &) {
+        mainUI.calcFunc = [=](Timeline::Span &, const FrameContext &frame) {
             SDD1306::instance().ClearChar();
             char str[32];
+#ifdef USE_PROFILER
+            if (profilerPage > 0) {
+                Profiler::Zone zone = Profiler::Zone(profilerPage - 1);
+                const Profiler::Stats &stats = Profiler::stats(zone);
+                sprintf(str,"%.9s", Profiler::name(zone));
+                SDD1306::instance().PlaceUTF8String(0,0,str);
+                sprintf(str,"n%8u", (unsigned)stats.count);
+                SDD1306::instance().PlaceUTF8String(0,1,str);
+                sprintf(str,"<%6.0fus", double(Profiler::toMicroseconds(stats.min)));
+                SDD1306::instance().PlaceUTF8String(0,2,str);
+                sprintf(str,"~%6.0fus", double(Profiler::toMicroseconds(stats.avg())));
+                SDD1306::instance().PlaceUTF8String(0,3,str);
+                sprintf(str,">%6.0fus", double(Profiler::toMicroseconds(stats.max)));
+                SDD1306::instance().PlaceUTF8String(0,4,str);
+                return;
+            }
+#endif  // #ifdef USE_PROFILER
             sprintf(str,"B:      |");
             SDD1306::instance().PlaceUTF8String(0,0,str);
-            sprintf(str,"D:%fs", Timeline::SystemTime());
+            sprintf(str,"D:%6us", unsigned(Timeline::Seconds(frame.time)));
             SDD1306::instance().PlaceUTF8String(0,1,str);
             sprintf(str,"T:%6.1fC", double(STM32WL::instance().Temperature()));
             SDD1306::instance().PlaceUTF8String(0,2,str);
@@ -57,8 +81,10 @@ void UI::init() {
             sprintf(str,"V:%6.1fV", double(STM32WL::instance().BatteryVoltage()));
             SDD1306::instance().PlaceUTF8String(0,4,str);
         };
-        mainUI.commitFunc = [=](Timeline::Span &) {
-            SDD1306::instance().Display();
+        mainUI.commitFunc = [=](Timeline::Span &span) {
+            // A page which did not change is looked at again a bit later, the switches wake us
+            // right away
+            span.stillUntil = SDD1306::instance().Display() ? 0 : Timeline::Now() + Timeline::stillRecheck;
         };
         mainUI.switch1Func = [=](Timeline::Span &, bool up) {
             if (up) { 
@@ -69,27 +95,33 @@ void UI::init() {
         mainUI.switch2Func = [=](Timeline::Span &, bool up) {
             if (up) { 
                 printf("SW2\n");
+#ifdef USE_PROFILER
+                profilerPage = ( profilerPage + 1 ) % ( Profiler::ZonesN + 1 );
+#endif  // #ifdef USE_PROFILER
             }
         };
         mainUI.switch3Func = [=](Timeline::Span &, bool up) {
             if (up) { 
                 printf("SW3\n");
+#ifdef USE_PROFILER
+                Profiler::dump();
+#endif  // #ifdef USE_PROFILER
             }
         };
         Timeline::instance().Add(mainUI);
     }
 
     static Timeline::Display bootScreen;
-    bootScreen.time = Timeline::SystemTime();
-    bootScreen.duration = 1.0; // timeout
+    bootScreen.time = Timeline::Now();
+    bootScreen.duration = Timeline::Ticks(1.0); // timeout
 
     static Timeline::Display moveOut;
     moveOut.time = bootScreen.time + bootScreen.duration;
-    moveOut.duration = 0.25; // timeout
+    moveOut.duration = Timeline::Ticks(0.25); // timeout
 
     static Timeline::Display moveIn;
     moveIn.time = moveOut.time + moveOut.duration;
-    moveIn.duration = 0.25; // timeout
+    moveIn.duration = Timeline::Ticks(0.25); // timeout
 
     bootScreen.startFunc = [=](Timeline::Span &) {
         SDD1306::instance().ClearChar();
@@ -97,10 +129,9 @@ void UI::init() {
         SDD1306::instance().SetBootScreen(true, 100);
         SDD1306::instance().Display();
     };
-    bootScreen.calcFunc = [=](Timeline::Span &span, Timeline::Span &) {
-        double now = Timeline::SystemTime();
-        double delta = ( (span.time + span.duration) - now ) / span.duration;
-        SDD1306::instance().SetBootScreen(true, static_cast<int32_t>(100.0f * Cubic::easeIn(static_cast<float>(delta), 0.0f, 1.0f, 1.0f)));
+    bootScreen.calcFunc = [=](Timeline::Span &span, const FrameContext &frame) {
+        float delta = span.Remaining(frame.time);
+        SDD1306::instance().SetBootScreen(true, static_cast<int32_t>(100.0f * Cubic::easeIn(delta, 0.0f, 1.0f, 1.0f)));
         SDD1306::instance().Display();
     };
     bootScreen.doneFunc = [=](Timeline::Span &span) {
@@ -113,10 +144,9 @@ void UI::init() {
     moveOut.startFunc = [=](Timeline::Span &) {
     };
 
-    moveOut.calcFunc = [=](Timeline::Span &span, Timeline::Span &) {
-        double now = Timeline::SystemTime();
-        double delta = ( (span.time + span.duration) - now ) / span.duration;
-        SDD1306::instance().SetVerticalShift(-static_cast<int8_t>(16.0f * (1.0f - Cubic::easeOut(static_cast<float>(delta), 0.0f, 1.0f, 1.0f))));
+    moveOut.calcFunc = [=](Timeline::Span &span, const FrameContext &frame) {
+        float delta = span.Remaining(frame.time);
+        SDD1306::instance().SetVerticalShift(-static_cast<int8_t>(16.0f * (1.0f - Cubic::easeOut(delta, 0.0f, 1.0f, 1.0f))));
         SDD1306::instance().Display();
     };
     moveOut.doneFunc = [=](Timeline::Span &span) {
@@ -134,11 +164,10 @@ void UI::init() {
         SDD1306::instance().Invalidate();
         SDD1306::instance().Display();
     };
-    moveIn.calcFunc = [=](Timeline::Span &span, Timeline::Span &below) {
-        below.Calc();
-        double now = Timeline::SystemTime();
-        double delta = ( (span.time + span.duration) - now ) / span.duration;
-        SDD1306::instance().SetCenterFlip(static_cast<int8_t>(48.0 * (delta)));
+    moveIn.calcFunc = [=](Timeline::Span &span, const FrameContext &frame) {
+        span.Below().Calc(frame);
+        float delta = span.Remaining(frame.time);
+        SDD1306::instance().SetCenterFlip(static_cast<int8_t>(48.0f * (delta)));
         SDD1306::instance().Display();
     };
     moveIn.doneFunc = [=](Timeline::Span &span) {